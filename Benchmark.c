@@ -0,0 +1,213 @@
+//-----------------------------------------
+//
+// REMARKS: Benchmarks for the object manager. Each
+//          benchmark runs the same workload with a
+//          feature off and on, and prints the timings
+//          side by side. Build with "make bench", which
+//          gives the object manager a larger memory pool.
+//-----------------------------------------
+
+#include "ObjectManager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// locality benchmark workload
+#define LOCALITY_OBJECT_SIZE 64
+#define LOCALITY_HOT_STRIDE 16 // every this many objects is hot
+#define LOCALITY_ROUNDS 200
+
+// huge page benchmark workload
+#define HUGE_OBJECT_SIZE 1024
+#define HUGE_ACCESSES 4000000
+
+//function prototypes
+static double elapsedNs(struct timespec* start, struct timespec* end);
+static double localityRun(ulong samplePeriod);
+static void benchmarkLocality();
+static int hugePageRun(int mode, double* pauseNs, double* accessNs);
+static void benchmarkHugePages();
+
+/*
+This function returns the nanoseconds between two
+readings of the monotonic clock.
+*/
+static double elapsedNs(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/*
+This function fills the pool with small objects, uses
+every LOCALITY_HOT_STRIDE-th one, fires garbage collection
+and then times reading the hot objects in a random order.
+It returns the average time per read in nanoseconds.
+*/
+static double localityRun(ulong samplePeriod)
+{
+  setHotObjectReordering(samplePeriod);
+  initPool();
+
+  int numObjects = MEMORY_SIZE / LOCALITY_OBJECT_SIZE - 1;
+  int numHot = numObjects / LOCALITY_HOT_STRIDE;
+  Ref* hotRefs = (Ref*)malloc(sizeof(Ref) * numHot);
+  long** hotPtrs = (long**)malloc(sizeof(long*) * numHot);
+
+  for(int i = 0; i < numObjects; i++)
+  {
+    Ref ref = insertObject(LOCALITY_OBJECT_SIZE);
+    if(i % LOCALITY_HOT_STRIDE == 0 && i / LOCALITY_HOT_STRIDE < numHot)
+    {
+      hotRefs[i / LOCALITY_HOT_STRIDE] = ref;
+    }
+  }
+
+  // the lookups that make the objects hot
+  for(int i = 0; i < numHot; i++)
+  {
+    long* object = (long*)retrieveObject(hotRefs[i]);
+    object[0] = i;
+  }
+
+  // fire garbage collection (there isn't room for this)
+  insertObject(MEMORY_SIZE);
+
+  // visit the hot objects in a fixed pseudo random order
+  unsigned int seed = 12345;
+  for(int i = 0; i < numHot; i++)
+  {
+    hotPtrs[i] = (long*)retrieveObject(hotRefs[i]);
+  }
+  for(int i = numHot - 1; i > 0; i--)
+  {
+    seed = seed * 1103515245 + 12345;
+    int j = (seed >> 8) % (i + 1);
+    long* temp = hotPtrs[i];
+    hotPtrs[i] = hotPtrs[j];
+    hotPtrs[j] = temp;
+  }
+
+  struct timespec start;
+  struct timespec end;
+  volatile long sum = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(int round = 0; round < LOCALITY_ROUNDS; round++)
+  {
+    for(int i = 0; i < numHot; i++)
+    {
+      sum = sum + hotPtrs[i][0];
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  free(hotPtrs);
+  free(hotRefs);
+  destroyPool();
+  setHotObjectReordering(0);
+  return elapsedNs(&start, &end) / ((double)LOCALITY_ROUNDS * numHot);
+}
+
+/*
+This benchmark compares reading hot objects scattered
+through the pool (allocation order) with reading them
+after hot object reordering laid them out together.
+*/
+static void benchmarkLocality()
+{
+  printf("\nBENCHMARK: HOT OBJECT REORDERING\n");
+  double scattered = localityRun(0);
+  double together = localityRun(1);
+  printf("\nAllocation order: %.2f ns per hot object read\n", scattered);
+  printf("Hot objects first: %.2f ns per hot object read\n", together);
+  printf("Speedup: %.2fx\n", scattered / together);
+}
+
+/*
+This function fills the pool with objects backed by the
+given kind of pages, drops every other one and times the
+garbage collection that compacts the rest, then times
+reads at random places in random live objects. It returns
+the kind of pages the pool actually got.
+*/
+static int hugePageRun(int mode, double* pauseNs, double* accessNs)
+{
+  setHugePages(mode);
+  initPool();
+  int obtained = getHugePages();
+
+  int numObjects = MEMORY_SIZE / HUGE_OBJECT_SIZE - 1;
+  Ref* refs = (Ref*)malloc(sizeof(Ref) * numObjects);
+  for(int i = 0; i < numObjects; i++)
+  {
+    refs[i] = insertObject(HUGE_OBJECT_SIZE);
+    long* object = (long*)retrieveObject(refs[i]);
+    object[0] = i;
+  }
+  for(int i = 0; i < numObjects; i = i + 2)
+  {
+    dropReference(refs[i]);
+  }
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  // fire garbage collection (there isn't room for this)
+  insertObject(MEMORY_SIZE);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  *pauseNs = elapsedNs(&start, &end);
+
+  int numLive = numObjects / 2;
+  uchar** live = (uchar**)malloc(sizeof(uchar*) * numLive);
+  for(int i = 0; i < numLive; i++)
+  {
+    live[i] = (uchar*)retrieveObject(refs[2 * i + 1]);
+  }
+
+  unsigned int seed = 12345;
+  volatile long sum = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(int i = 0; i < HUGE_ACCESSES; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    sum = sum + live[(seed >> 8) % numLive][seed % HUGE_OBJECT_SIZE];
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  *accessNs = elapsedNs(&start, &end) / HUGE_ACCESSES;
+
+  free(live);
+  free(refs);
+  destroyPool();
+  setHugePages(HUGE_PAGES_NONE);
+  return obtained;
+}
+
+/*
+This benchmark compares the garbage collection pause and
+random object reads with the buffers backed by normal 4KB
+pages and by 2MB huge pages.
+*/
+static void benchmarkHugePages()
+{
+  const char* pageNames[] = { "4KB pages", "transparent 2MB pages", "explicit 2MB pages" };
+  int modes[] = { HUGE_PAGES_NONE, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT };
+
+  printf("\nBENCHMARK: HUGE PAGES\n");
+  for(int i = 0; i < 3; i++)
+  {
+    double pauseNs;
+    double accessNs;
+    int obtained = hugePageRun(modes[i], &pauseNs, &accessNs);
+    printf("\nAsked for %s, got %s\n", pageNames[modes[i]], pageNames[obtained]);
+    printf("Garbage collection pause: %.0f us\n", pauseNs / 1000);
+    printf("Random read: %.2f ns\n", accessNs);
+  }
+}
+
+int main()
+{
+  benchmarkLocality();
+  benchmarkHugePages();
+
+  printf("\nEND OF BENCHMARKS\n");
+  return 0;
+}
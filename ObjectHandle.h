@@ -0,0 +1,131 @@
+/*
+ * ObjectHandle.h
+ *
+ * Handle<T>, a C++ handle that holds one reference on an object of the
+ * object manager for as long as it exists, so callers don't have to pair
+ * every addReference with a dropReference by hand.
+ *
+ * Copying a handle adds a reference and destroying one drops it. Moving a
+ * handle hands its reference over without touching the count, so handles
+ * can be returned from functions and kept in containers for free. get()
+ * returns the object as a T* through retrieveObject, which is only good
+ * until the next call that may fire the garbage collector.
+ *
+ * Handles must be gone before destroyPool is called, since dropping their
+ * references needs the pool.
+ */
+
+#ifndef _OBJECT_HANDLE_H
+#define _OBJECT_HANDLE_H
+
+#include "ObjectManager.h"
+#include <stddef.h>
+
+template<typename T>
+class Handle
+{
+public:
+  // a handle to nothing
+  Handle() : ref(NULL_REF) {}
+
+  // takes over a reference the caller holds (e.g. from insertObject)
+  explicit Handle(Ref held) : ref(held) {}
+
+  // inserts an object big enough for a T (or size bytes), NULL on failure
+  static Handle insert(ulong size = sizeof(T))
+  {
+    return Handle(insertObject(size));
+  }
+
+  Handle(const Handle& other) : ref(other.ref)
+  {
+    if(ref != NULL_REF)
+    {
+      addReference(ref);
+    }
+  }
+
+  Handle(Handle&& other) noexcept : ref(other.ref)
+  {
+    other.ref = NULL_REF;
+  }
+
+  Handle& operator=(const Handle& other)
+  {
+    // add before dropping, so assigning a handle to itself is harmless
+    Ref held = other.ref;
+    if(held != NULL_REF)
+    {
+      addReference(held);
+    }
+    reset();
+    ref = held;
+    return *this;
+  }
+
+  Handle& operator=(Handle&& other) noexcept
+  {
+    if(this != &other)
+    {
+      reset();
+      ref = other.ref;
+      other.ref = NULL_REF;
+    }
+    return *this;
+  }
+
+  ~Handle()
+  {
+    reset();
+  }
+
+  // the object, NULL if the handle is empty
+  T* get() const
+  {
+    return (ref != NULL_REF) ? (T*)retrieveObject(ref) : NULL;
+  }
+
+  T* operator->() const
+  {
+    return get();
+  }
+
+  T& operator*() const
+  {
+    return *get();
+  }
+
+  explicit operator bool() const
+  {
+    return ref != NULL_REF;
+  }
+
+  // the reference, which stays held by the handle
+  Ref getRef() const
+  {
+    return ref;
+  }
+
+  // gives the reference up to the caller, who must drop it
+  Ref release()
+  {
+    Ref held = ref;
+    ref = NULL_REF;
+    return held;
+  }
+
+  // drops the reference and leaves the handle empty
+  void reset()
+  {
+    if(ref != NULL_REF)
+    {
+      dropReference(ref);
+      ref = NULL_REF;
+    }
+  }
+
+private:
+  Ref ref;
+};
+
+#endif
@@ -8,7 +8,73 @@
 #include "ObjectManager.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+
+// tracepoints (see getTraceEvents) are compiled in with -DENABLE_TRACEPOINTS,
+// as USDT probes too where sys/sdt.h is available
+#ifdef ENABLE_TRACEPOINTS
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACEPOINT_PROBE(name, first, second) DTRACE_PROBE2(objectmanager, name, first, second)
+#endif
+#endif
+#ifndef TRACEPOINT_PROBE
+#define TRACEPOINT_PROBE(name, first, second)
+#endif
+#define TRACEPOINT(type, name, first, second) \
+  do { TRACEPOINT_PROBE(name, first, second); recordTraceEvent(type, first, second); } while(0)
+#else
+// still type checked, but compiled to nothing
+#define TRACEPOINT(type, name, first, second) \
+  do { if(0) { recordTraceEvent(type, first, second); } } while(0)
+#endif
+
+// deepest nesting of scopes we keep track of
+#define MAX_SCOPE_DEPTH 64
+// number of reference count changes buffered in deferred mode
+#define REF_LOG_SIZE 4096
+// default yield (% of memory) below which the cycle collector runs
+#define DEFAULT_CYCLE_PERCENT 5
+// default garbage (% of used memory) at which gcMaybeCollect collects
+#define DEFAULT_IDLE_DEAD_PERCENT 25
+// identifies a pool image written by savePool
+#define POOL_IMAGE_MAGIC 0x4c4f4f504d424f48UL
+// entries in the ref to node translation cache (a power of 2)
+#ifndef TRANSLATION_CACHE_SIZE
+#define TRANSLATION_CACHE_SIZE 4096
+#endif
+// size of a huge page on the platforms we support
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+// longest shared memory segment name (see initSharedPool)
+#define SHARED_NAME_SIZE 256
+// how long an attaching process waits for the creator to finish (ms)
+#define SHARED_ATTACH_TIMEOUT_MS 5000
+// bytes dumpPoolTo buffers between writes
+#define DUMP_BUFFER_SIZE (64 * 1024)
+// invariant checking level a pool starts out with (see setCheckLevel)
+#ifndef CHECK_LEVEL
+#define CHECK_LEVEL CHECK_FULL
+#endif
+// checkIndex calls per full walk of the index at CHECK_SAMPLED
+#ifndef CHECK_SAMPLE_PERIOD
+#define CHECK_SAMPLE_PERIOD 1024
+#endif
+// events kept by the tracepoint event log (a power of 2)
+#ifndef TRACE_EVENT_LOG_SIZE
+#define TRACE_EVENT_LOG_SIZE 1024
+#endif
+// bytes the operation trace buffers between writes
+#define TRACE_BUFFER_SIZE (256 * 1024)
 
 // node Struct
 typedef struct NODE Node;
@@ -16,16 +82,127 @@ struct NODE
 {
   int memStartIndex; //offset index
   ulong memSize;
+  ulong refSlotCount; // ref fields at the start of the object
   int objReferenceCount;
   Ref objReferenceID;
+  int inZeroCountTable; // count reached 0 in the deferred batch being applied
+  int externalCount; // references from outside the pool (cycle collector)
+  int marked; // reachable in the current marking pass
+  ulong accessCount; // sampled retrieveObject calls (hot object reordering)
+  int isClone; // contents are shared with other clones (copy-on-write)
+  Node* storage; // node keeping the contents of a clone, held by a reference
+  int hidden; // keeps the contents of clones, its ref is never handed out
+  const char* site; // where it was allocated (heap profiling), NULL if not sampled
+  ulong birth; // garbage collections run before it was allocated
   Node* next;
 };
 
+// logged reference count change (deferred reference counting)
+typedef struct REF_LOG_ENTRY RefLogEntry;
+struct REF_LOG_ENTRY
+{
+  Ref ref;
+  int delta; // +1 or -1
+  int sequence; // position in the log, keeps changes to one object in order
+};
+
+// translation cache entry, remembers where findNode found a ref
+typedef struct TRANSLATION_ENTRY TranslationEntry;
+struct TRANSLATION_ENTRY
+{
+  Ref ref;
+  Node* node;
+  ulong epoch; // only valid if it matches pool->indexEpoch
+};
+
+// recent findNode results for one pool (or shard)
+typedef struct TRANSLATION_CACHE TranslationCache;
+struct TRANSLATION_CACHE
+{
+  TranslationEntry entries[TRANSLATION_CACHE_SIZE];
+  ulong hits;
+  ulong misses;
+};
+
+// start of a pool image file (see savePool)
+typedef struct POOL_IMAGE_HEADER PoolImageHeader;
+struct POOL_IMAGE_HEADER
+{
+  ulong magic;
+  ulong memorySize; // MEMORY_SIZE of the pool that wrote the image
+  ulong referenceID; // next reference id to hand out
+  ulong numObjects;
+  ulong usedBytes; // bytes of buffer contents in the image
+  ulong dataOffset; // page aligned file offset of the buffer contents
+};
+
+// one object in a pool image, the records follow the header
+typedef struct POOL_IMAGE_RECORD PoolImageRecord;
+struct POOL_IMAGE_RECORD
+{
+  Ref ref;
+  ulong memStartIndex;
+  ulong memSize;
+  ulong refSlotCount;
+  long objReferenceCount;
+  Ref storageRef; // the storage node of a clone, NULL_REF otherwise
+  long hidden; // 1 for the storage node of clones
+};
+
 // index linked list struct
 typedef struct INDEX Index;
 struct INDEX
 {
   Node* top;
+  Node* last; // end of the list, so inserting at the end doesn't walk it
+};
+
+// state of the memory pool. A shared pool keeps it at the start of its
+// shared memory segment so that every process attached sees the same
+// state; the segment is mapped at the same address in every process,
+// so the pointers in it are valid everywhere.
+typedef struct POOL_STATE PoolState;
+struct POOL_STATE
+{
+  uchar* activeBuffer; // two buffers for double buffering
+  uchar* inactiveBuffer;
+  Ref referenceID; //keeps track of the highest id that has been given out
+  int nextAvailableIndex; // next available index in the buffer
+  Index* indexing; // index to keep track of objects
+  ulong deadBytes; // bytes that became garbage since the last collection
+  int reserveBackoff; // in the emergency reserve, and nothing let go of since the last collection
+  ulong bytesSinceCollection; // bytes allocated since the last collection
+  ulong lastCollectionTime; // when the last collection ran (ns)
+  ulong indexEpoch; // bumped whenever nodes are destroyed
+  ulong numCollections; // garbage collections run so far
+  ulong lastPauseNs; // how long the last collection took
+  ulong activeHighWater; // bytes of the active buffer that may be in memory
+  ulong inactiveHighWater; // bytes of the inactive buffer that may be in memory
+  int hugePages; // HUGE_PAGES_* the buffers ended up backed by
+  ulong bufferMapSize; // bytes mapped for each buffer
+  ulong bufferPageSize; // size of the pages backing the buffers
+  // the rest is only used by shared pools
+  int shared; // 1 if this state lives in a shared memory segment
+  pthread_mutex_t lock; // held by the process using the pool
+  Index sharedIndex; // the index of a shared pool
+  Node* freeNodes; // nodes of the segment not in the index
+  void* segmentBase; // where every process maps the segment
+  ulong segmentSize;
+  int numAttached; // processes using the pool
+  int ready; // set once the creator has finished setting the pool up
+  char segmentName[SHARED_NAME_SIZE];
+};
+
+// one shard of a sharded pool (see initShardedPool)
+typedef struct SHARD Shard;
+struct SHARD
+{
+  PoolState state; // its buffers, index and lock
+  TranslationCache cache;
+  pthread_mutex_t inboxLock; // only ever held on its own
+  RefLogEntry* inbox; // count changes from other shards, applied in order
+  int inboxLength;
+  int inboxCapacity;
 };
 
 //---------------------------------------------------
@@ -33,18 +210,74 @@ struct INDEX
 //---------------------------------------------------
 
 static int numObjMngrs = 0; // # of object managers initialised
-static uchar* activeBuffer; // two buffers for double buffering
-static uchar* inactiveBuffer;
-static Ref referenceID; //keeps track of the highest id that has been given out
-static int nextAvailableIndex; // next available index in the buffer
-static Index* indexing; // index to keep track of objects
+static PoolState privatePool; // state of a pool that isn't shared
+static PoolState* mainPool = &privatePool; // state of the pool in use (the first shard if sharded)
+static Shard* shards; // shards of a sharded pool
+static int numShards = 0; // 0 if the pool isn't sharded
+static __thread Shard* threadShard; // shard the calling thread is working on
+static __thread int homeShard = -1; // shard the thread allocates from, -1 for its core's
+static Ref scopeStack[MAX_SCOPE_DEPTH]; // first ref handed out in each open scope
+static int scopeDepth; // number of scopes currently open
+static int deferredCounting = 0; // 1 if reference count changes are logged
+static RefLogEntry refLog[REF_LOG_SIZE]; // changes waiting to be applied
+static int refLogLength;
+static Node* zeroCountTable[REF_LOG_SIZE]; // nodes taken to 0 by the current batch
+static int zeroCountLength;
+static int cycleCollectionPercent = DEFAULT_CYCLE_PERCENT; // cycles are looked for below this yield
+static int collectionMode = COLLECT_REFERENCE_COUNTING; // how garbage is identified
+static Ref* roots; // root references registered in tracing mode
+static int numRoots;
+static int rootsCapacity;
+static Ref** rootSlots; // root variables registered in tracing mode
+static int numRootSlots;
+static int rootSlotsCapacity;
+static int triggerDeadPercent = 0; // garbage % that makes insertObject collect early
+static int idleDeadPercent = DEFAULT_IDLE_DEAD_PERCENT; // garbage % that makes gcMaybeCollect collect
+static ulong idleHeadroomMs = 0; // gcMaybeCollect collects if memory would run out this soon
+static ulong accessSamplePeriod = 0; // every this many retrieveObject calls is counted (0 = off)
+static __thread ulong accessTicker; // retrieveObject calls since the last sample
+static ulong profileSamplePeriod = 0; // every this many allocations is profiled (0 = off)
+static __thread ulong profileTicker; // allocations since the last sample
+static const char* allocationSite = "unknown"; // site given to objects allocated from now on
+static TranslationCache privateCache; // recent findNode results, for a pool that isn't sharded
+static int pageReleaseEnabled = 0; // 1 if unused pages are given back after collecting
+static ulong pageReleaseSlack; // bytes kept in memory past the used part of the buffer
+static int hugePagesRequested = HUGE_PAGES_NONE; // what the next pool's buffers should be backed by
+static int checkLevel = CHECK_LEVEL; // how thoroughly invariants are checked
+static __thread ulong checkTicker; // checkIndex calls since the last full walk (CHECK_SAMPLED)
+static int threadSafe = 0; // 1 if the private pool is locked like a shared one
+static int privateLockReady = 0; // 1 once privatePool.lock has been initialised
+static TraceEvent traceEvents[TRACE_EVENT_LOG_SIZE]; // latest tracepoint events, a ring
+static ulong numTraceEvents; // events recorded since the process started
+static int gcLogging = 1; // 1 if garbage collections print their statistics
+static FILE* traceFile; // where operations are recorded, NULL if they aren't
+static ulong traceStartNs; // when recording started
+static __thread int traceSuspended; // > 0 while calls are made on the caller's behalf
+static LowMemoryCallback lowMemoryCallback; // asked to let go of objects when an insert won't fit
+static void* lowMemoryContext; // passed to the callback
+static __thread int inLowMemoryCallback; // 1 while the callback runs on this thread
+static ulong emergencyReserve = 0; // bytes at the end of the buffer inserts only get as a last resort
 
 //---------------------
 // FUNCTION PROTOTYPES
 //---------------------
 
+// memory pool set up functions
+static void setUpPool();
+static void resetLocalState();
+static TranslationCache* currentCache();
+static int createSharedPool(const char* name, ulong maxObjects);
+static int attachSharedPool(const char* name);
+static void detachSharedPool();
+static void destroyShards();
+static uchar* mapBuffers();
+static void unmapBuffers();
+static ulong pageAlign(ulong numBytes);
+static ulong roundUp(ulong numBytes, ulong multiple);
+
 // node struct functions
 static Node* makeNode(ulong memSize);
+static int nodesAvailable(int numNodes);
 static void destroyNode(Node* aNode);
 static void checkNode(Node* aNode);
 
@@ -54,15 +287,84 @@ static void destroyIndex(Index* anIndex);
 static void checkIndex(Index* anIndex);
 
 // garbage collection related functions
-static int garbageExists();
 static void compact();
-static void copyActToNonact();
+static int copyActToNonact();
+static void copyHotFirst();
+static int compareHotness(const void* a, const void* b);
 static void swapBuffers();
+static void releaseUnusedPages();
 static void updateIndex();
 static void insertAtEnd(Node* aNode);
+static void removeNode(Node* aNode);
+static void removeNodes(Node** nodes, int numNodes);
+static int compareStarts(const void* a, const void* b);
+static int absorbDeadBlocks(Node* aNode, ulong newSize, ulong limit);
+static void releaseDeadChildren();
+static void releaseRefFields(Node* aNode);
+static ulong garbageBytes();
+static int collectCycles();
+static void markFrom(Node** table, int length, Node** worklist, int pending);
+static void traceFromRoots();
+static void* growArray(void* array, int* capacity, int elementSize);
+
+// low memory functions
+static int roomFor(ulong size, ulong limit, int numNodes);
+static int growAtEnd(Node* aNode, ulong newSize, ulong limit);
+
+// collection triggering functions
+static ulong estimatedGarbage();
+static int collectionDue(int percent);
+static ulong currentTimeNs();
+
+// ref field access
+static Ref readRefSlot(Node* aNode, ulong slot);
+static void writeRefSlot(Node* aNode, ulong slot, Ref value);
+static uchar* objectData(Node* aNode);
+static ulong numChildren(Node* aNode);
+static Ref readChild(Node* aNode, ulong child);
+static void clearChild(Node* aNode, ulong child);
+
+// copy-on-write clone functions
+static int ownContents(Ref ref);
+static void releaseStorage(Node* aNode);
+
+// work done under the pool's lock by the public calls
+static Ref insertInPool(ulong size, ulong refSlotCount);
+static void* retrieveFromPool(Ref ref);
 
 // find the node by the given ref
 static Node* findNode(Ref ref);
+static void invalidateTranslationCache();
+static Node** makeNodeTable(int* length);
+static Node* searchNodeTable(Node** table, int length, Ref ref);
+
+// sharded pool functions
+static PoolState* currentPool();
+static Shard* enterShard(Ref ref);
+static Shard* enterHomeShard();
+static void leaveShard(Shard* previous);
+static int inOtherShard(Ref ref);
+static void queueShardChange(Ref ref, int delta);
+static void applyShardInbox();
+
+// operation trace functions
+static void traceOperation(ulong op, Ref ref, ulong first, ulong second);
+
+// tracepoint functions
+static void recordTraceEvent(int type, ulong first, ulong second);
+static void raiseHighWater();
+
+// heap dump functions
+static Node* nextLiveNode(Node* curr);
+
+// heap profiling functions
+static int compareSites(const void* a, const void* b);
+static int ageBucket(ulong age);
+
+// deferred reference counting functions
+static void logReferenceChange(Ref ref, int delta);
+static void applyReferenceLog();
+static int compareLogEntries(const void* a, const void* b);
 
 //------------------------------------------------------
 // initPool
@@ -79,16 +381,7 @@ void initPool()
     //manager initialised already
   if(numObjMngrs == 0)
   {
-    // initialise all global variables
-    activeBuffer = (uchar*)(malloc(sizeof(uchar) * MEMORY_SIZE));
-    inactiveBuffer = (uchar*)(malloc(sizeof(uchar) * MEMORY_SIZE));
-    assert(activeBuffer != NULL);
-    assert(inactiveBuffer != NULL);
-    referenceID = 1;
-    nextAvailableIndex = 0; //starting at index 0
-    indexing = makeIndex();
-    checkIndex(indexing);
-    numObjMngrs++;
+    setUpPool();
   }
   else
   {
@@ -97,496 +390,4734 @@ void initPool()
 } // end of initPool()
 
 //------------------------------------------------------
-// destroyPool
+// setUpPool
 //
-// PURPOSE: cleans up all the memory being used by the
-//          Object manager.
+// PURPOSE: allocates the buffers and index of an empty
+//          memory pool and initialises all global variables.
 //
 // (No return type or input/output parameters)
 //------------------------------------------------------
-void destroyPool()
+static void setUpPool()
 {
-  // if there is actually an object manager initialised that needs to cleaned up
-  if(numObjMngrs != 0)
+  PoolState* const pool = currentPool();
+  assert(numObjMngrs == 0);
+  // initialise all global variables. A shared pool's buffers and
+  // index are already laid out in its segment
+  if(!pool->shared)
   {
-    numObjMngrs--;
-    // check all resources are valid before destroying
-    assert(activeBuffer != NULL);
-    assert(inactiveBuffer != NULL);
-    checkIndex(indexing);
-    // clean up memory being used
-    free(activeBuffer);
-    activeBuffer = NULL;
-    free(inactiveBuffer);
-    inactiveBuffer = NULL;
-    destroyIndex(indexing);
+    pool->hugePages = hugePagesRequested;
+    pool->activeBuffer = mapBuffers();
+    pool->inactiveBuffer = (pool->activeBuffer != NULL) ? pool->activeBuffer + pool->bufferMapSize : NULL;
+    pool->indexing = makeIndex();
   }
-} // end of destroyPool()
+  assert(pool->activeBuffer != NULL);
+  assert(pool->inactiveBuffer != NULL);
+  pool->referenceID = 1;
+  pool->nextAvailableIndex = 0; //starting at index 0
+  pool->deadBytes = 0;
+  pool->reserveBackoff = 0;
+  pool->bytesSinceCollection = 0;
+  pool->lastCollectionTime = currentTimeNs();
+  pool->activeHighWater = 0;
+  pool->inactiveHighWater = 0;
+  pool->numCollections = 0;
+  pool->lastPauseNs = 0;
+  invalidateTranslationCache();
+  checkIndex(pool->indexing);
+  resetLocalState();
+  numObjMngrs++;
+} // end of setUpPool()
 
 //------------------------------------------------------
-// insertObject
+// resetLocalState
 //
-// PURPOSE: This function trys to allocate a block of given
-//          size from our buffer. It will fire the garbage
-//          collector as required.
+// PURPOSE: initialises the global variables that belong to
+//          this process rather than to the pool, for a pool
+//          that was just set up or attached to.
+//
+// (No return type or input/output parameters)
+//------------------------------------------------------
+static void resetLocalState()
+{
+  scopeDepth = 0;
+  refLogLength = 0;
+  zeroCountLength = 0;
+  // entries left over from an earlier pool may carry a matching epoch
+  memset(currentCache(), 0, sizeof(TranslationCache));
+} // end of resetLocalState()
+
+//------------------------------------------------------
+// currentCache
+//
+// PURPOSE: finds the translation cache of the pool (or
+//          shard) the current call works on
+//
+// RETURN:
+// the translation cache
+//------------------------------------------------------
+static TranslationCache* currentCache()
+{
+  return (threadShard != NULL) ? &(threadShard->cache) : &privateCache;
+} // end of currentCache()
+
+//------------------------------------------------------
+// initSharedPool
+//
+// PURPOSE: initialises the object manager with a memory pool
+//          that several processes can use at the same time.
+//          The pool state, index, nodes and both buffers live
+//          in one POSIX shared memory segment with the given
+//          name. The first process to call this creates the
+//          segment, the others attach to it. The segment is
+//          mapped at the same address in every process, so
+//          the pointers kept in it mean the same thing
+//          everywhere, and so does every Ref.
 //
 // INPUT PARAMETERS:
-// size - the amount of bytes being requested for allocation
-//        for an object
+// name - name of the shared memory segment (e.g. "/pool")
+// maxObjects - the most objects the index can hold at once,
+//              only used by the process creating the segment
 //
 // RETURN:
-// if memory is allocated successfully, it returns the reference
-// number for the block of memory allocated for the object.
-// Otherwise, it returns NULL_REF (0)
+// 1 if the pool was created or attached to, 0 otherwise
 //------------------------------------------------------
-Ref insertObject(ulong size)
+int initSharedPool(const char* name, ulong maxObjects)
 {
-  assert(numObjMngrs != 0);
-  // size cannot be negative
-  assert(size >= 0);
-  Ref returnRef = NULL_REF;
+  int initialised = 0;
 
-  if(numObjMngrs != 0)
+  // the roots, scopes and reference log are private to each process
+  if(numObjMngrs == 0 && name != NULL && strlen(name) < SHARED_NAME_SIZE && maxObjects > 0
+     && collectionMode == COLLECT_REFERENCE_COUNTING)
+  {
+    initialised = createSharedPool(name, maxObjects);
+    if(!initialised && errno == EEXIST)
+    {
+      initialised = attachSharedPool(name);
+    }
+    if(!initialised)
+    {
+      printf("Unable to initialise the shared memory pool %s\n", name);
+    }
+  }
+  else if(numObjMngrs != 0)
+  {
+    printf("\nThere is an Object Manager initialised already!\n");
+  }
+  else
+  {
+    printf("A shared memory pool needs a name, room for objects and reference counting.\n");
+  }
+  return initialised;
+} // end of initSharedPool()
+
+//------------------------------------------------------
+// createSharedPool
+//
+// PURPOSE: creates the shared memory segment for a shared
+//          pool and sets the pool up in it. The segment holds
+//          the pool state, then an array of maxObjects nodes,
+//          then the two buffers, each on a page boundary.
+//
+// INPUT PARAMETERS:
+// name - name of the shared memory segment
+// maxObjects - number of nodes in the segment
+//
+// RETURN:
+// 1 if the pool was created, 0 otherwise (errno is EEXIST if
+// the segment exists already)
+//------------------------------------------------------
+static int createSharedPool(const char* name, ulong maxObjects)
+{
+  int created = 0;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if(fd >= 0)
   {
-    //nothing is allocated if 0 bytes, or more than total memory
-    //available is requested
-    if (size > 0 && size <= MEMORY_SIZE)
+    ulong nodesOffset = pageAlign(sizeof(PoolState));
+    ulong buffersOffset = nodesOffset + pageAlign(maxObjects * sizeof(Node));
+    ulong segmentSize = buffersOffset + 2 * pageAlign(MEMORY_SIZE);
+    void* segment = MAP_FAILED;
+    if(ftruncate(fd, segmentSize) == 0)
+    {
+      segment = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if(segment != MAP_FAILED)
     {
-      // if there is room available on the buffer for the requested amount
-      if(size <= (MEMORY_SIZE - nextAvailableIndex))
+      mainPool = (PoolState*)segment;
+      PoolState* const pool = currentPool();
+      pool->shared = 1;
+      pool->segmentBase = segment;
+      pool->segmentSize = segmentSize;
+      strcpy(pool->segmentName, name);
+      pool->hugePages = HUGE_PAGES_NONE;
+      pool->bufferMapSize = pageAlign(MEMORY_SIZE);
+      pool->bufferPageSize = pageAlign(1);
+      pool->activeBuffer = (uchar*)segment + buffersOffset;
+      pool->inactiveBuffer = pool->activeBuffer + pageAlign(MEMORY_SIZE);
+      pool->indexing = &(pool->sharedIndex);
+      pool->indexing->top = NULL;
+      pool->indexing->last = NULL;
+
+      // every node starts out free
+      Node* nodes = (Node*)((uchar*)segment + nodesOffset);
+      pool->freeNodes = NULL;
+      for(ulong i = maxObjects; i > 0; i--)
       {
-        //allocate memory and update index
-        returnRef = referenceID;
-        Node* insertNode = makeNode(size);
-        checkNode(insertNode);
-        insertAtEnd(insertNode);
+        nodes[i - 1].next = pool->freeNodes;
+        pool->freeNodes = &(nodes[i - 1]);
       }
-      else
+
+      // the lock is held across calls that call each other, and is
+      // given back if a process dies holding it
+      pthread_mutexattr_t attributes;
+      pthread_mutexattr_init(&attributes);
+      pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+      pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&(pool->lock), &attributes);
+      pthread_mutexattr_destroy(&attributes);
+
+      setUpPool();
+      pool->numAttached = 1;
+      __atomic_store_n(&(pool->ready), 1, __ATOMIC_RELEASE);
+      created = 1;
+    }
+    else
+    {
+      shm_unlink(name);
+    }
+  }
+  return created;
+} // end of createSharedPool()
+
+//------------------------------------------------------
+// attachSharedPool
+//
+// PURPOSE: attaches to a shared pool created by another
+//          process. The segment is mapped at the address
+//          recorded in it; if something else already uses
+//          that address in this process we can't attach.
+//
+// INPUT PARAMETERS:
+// name - name of the shared memory segment
+//
+// RETURN:
+// 1 if the pool was attached to, 0 otherwise
+//------------------------------------------------------
+static int attachSharedPool(const char* name)
+{
+  int attached = 0;
+  int fd = shm_open(name, O_RDWR, 0600);
+
+  if(fd >= 0)
+  {
+    // wait for the creator to finish setting the pool up
+    PoolState* state = NULL;
+    struct stat info;
+    for(int waited = 0; waited < SHARED_ATTACH_TIMEOUT_MS && state == NULL; waited++)
+    {
+      if(fstat(fd, &info) == 0 && (ulong)info.st_size >= sizeof(PoolState))
       {
-        //space not available, fire garbage collection
-        compact();
-        // check if enough space available even after garbage collecting
-        if(size <= (MEMORY_SIZE - nextAvailableIndex))
+        void* header = mmap(NULL, sizeof(PoolState), PROT_READ, MAP_SHARED, fd, 0);
+        if(header != MAP_FAILED && __atomic_load_n(&(((PoolState*)header)->ready), __ATOMIC_ACQUIRE))
+        {
+          state = (PoolState*)header;
+        }
+        else if(header != MAP_FAILED)
         {
-          // allocate if room created after garbage collection
-          returnRef = referenceID;
-          Node* insertNode = makeNode(size);
-          checkNode(insertNode);
-          insertAtEnd(insertNode);
+          munmap(header, sizeof(PoolState));
         }
       }
+      if(state == NULL)
+      {
+        usleep(1000);
+      }
+    }
+
+    if(state != NULL)
+    {
+      void* base = state->segmentBase;
+      ulong segmentSize = state->segmentSize;
+      munmap(state, sizeof(PoolState));
+      void* segment = mmap(base, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if(segment == base)
+      {
+        mainPool = (PoolState*)segment;
+        PoolState* const pool = currentPool();
+        numObjMngrs++;
+        lockPool();
+        pool->numAttached++;
+        unlockPool();
+        resetLocalState();
+        attached = 1;
+      }
+      else if(segment != MAP_FAILED)
+      {
+        // the address was taken, the pointers in the segment would be wrong
+        munmap(segment, segmentSize);
+      }
     }
-    checkIndex(indexing);
+    close(fd);
   }
-  else
+  return attached;
+} // end of attachSharedPool()
+
+//------------------------------------------------------
+// detachSharedPool
+//
+// PURPOSE: stops this process using a shared pool. The last
+//          process to detach removes the segment.
+//
+// (No return type or input/output parameters)
+//------------------------------------------------------
+static void detachSharedPool()
+{
+  PoolState* const pool = currentPool();
+  assert(pool->shared);
+  char name[SHARED_NAME_SIZE];
+  strcpy(name, pool->segmentName);
+
+  lockPool();
+  pool->numAttached--;
+  int last = (pool->numAttached == 0);
+  unlockPool();
+
+  munmap(pool->segmentBase, pool->segmentSize);
+  mainPool = &privatePool;
+  if(last)
   {
-    printf("There are no object managers initialised. Initialise an object manager to gain access to memory.\n");
+    shm_unlink(name);
   }
-  return returnRef;
-} // end of insertObject()
+} // end of detachSharedPool()
 
 //------------------------------------------------------
-// insertAtEnd
+// initShardedPool
 //
-// PURPOSE: inserts a Node at the end of the object manager's
-//          index (i.e. the linked list)
+// PURPOSE: initialises the object manager with a memory pool
+//          made of several independent shards, each with its
+//          own buffers, index, translation cache and lock,
+//          set up just like the pool initPool makes. Shard s
+//          hands out the refs from (s << SHARD_SHIFT) + 1 on,
+//          so the shard of every Ref can be read off it, and
+//          each shard's index is still in reference order.
 //
 // INPUT PARAMETERS:
-// aNode - the node being inserted in the index
+// count - the number of shards, 1 to MAX_SHARDS
+//
+// RETURN:
+// 1 if the pool was initialised, 0 otherwise
 //------------------------------------------------------
-static void insertAtEnd(Node* aNode)
+int initShardedPool(int count)
 {
-  checkIndex(indexing);
-  checkNode(aNode);
+  int initialised = 0;
 
-  // case 1: index is empty
-  if(indexing->top == NULL)
+  // deferred counting, scopes and the roots of tracing are per process
+  if(numObjMngrs == 0 && count >= 1 && count <= MAX_SHARDS && collectionMode == COLLECT_REFERENCE_COUNTING)
   {
-    indexing->top = aNode;
-  }   
+    shards = (Shard*)calloc(count, sizeof(Shard));
+    assert(shards != NULL);
+    numShards = count;
+    mainPool = &(shards[0].state);
+
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    for(int shard = 0; shard < count; shard++)
+    {
+      threadShard = &(shards[shard]);
+      PoolState* const pool = currentPool();
+      // recursive, since public functions call each other
+      pthread_mutex_init(&(pool->lock), &attributes);
+      pthread_mutex_init(&(threadShard->inboxLock), NULL);
+      setUpPool();
+      pool->referenceID = ((Ref)shard << SHARD_SHIFT) + 1;
+      // the shards make up a single object manager
+      numObjMngrs--;
+    }
+    pthread_mutexattr_destroy(&attributes);
+    threadShard = NULL;
+    numObjMngrs++;
+    initialised = 1;
+  }
+  else if(numObjMngrs != 0)
+  {
+    printf("\nThere is an Object Manager initialised already!\n");
+  }
   else
   {
-    // case 2: index not empty
-    Node* curr = indexing->top;
-    Node* prev = NULL;
-    // iterate index to get to the end
-    while(curr != NULL)
+    printf("A sharded memory pool needs 1 to %d shards and reference counting.\n", MAX_SHARDS);
+  }
+  return initialised;
+} // end of initShardedPool()
+
+//------------------------------------------------------
+// destroyShards
+//
+// PURPOSE: gives back the buffers, index and inbox of every
+//          shard of a sharded pool, and the shards themselves.
+//
+// (No return type or input/output parameters)
+//------------------------------------------------------
+static void destroyShards()
+{
+  assert(numShards > 0);
+  for(int shard = 0; shard < numShards; shard++)
+  {
+    threadShard = &(shards[shard]);
+    PoolState* const pool = currentPool();
+    checkIndex(pool->indexing);
+    unmapBuffers();
+    destroyIndex(pool->indexing);
+    free(threadShard->inbox);
+    pthread_mutex_destroy(&(threadShard->inboxLock));
+    pthread_mutex_destroy(&(pool->lock));
+  }
+  threadShard = NULL;
+  free(shards);
+  shards = NULL;
+  numShards = 0;
+  mainPool = &privatePool;
+} // end of destroyShards()
+
+//------------------------------------------------------
+// setHomeShard
+//
+// PURPOSE: chooses the shard the calling thread allocates
+//          from. By default it is the one for the core the
+//          thread is running on at the time.
+//
+// INPUT PARAMETERS:
+// shard - the shard to allocate from, -1 for the core's
+//------------------------------------------------------
+void setHomeShard(int shard)
+{
+  assert(shard >= -1 && shard < MAX_SHARDS);
+  homeShard = (shard >= 0 && shard < MAX_SHARDS) ? shard : -1;
+} // end of setHomeShard()
+
+//------------------------------------------------------
+// lockPool
+//
+// PURPOSE: keeps other processes from using a shared pool
+//          until unlockPool is called. Every function of the
+//          object manager does this itself; callers only need
+//          to when a pointer from retrieveObject must stay
+//          valid, i.e. no other process may collect garbage.
+//          Calls can be nested. Does nothing for a private
+//          pool unless it was made thread safe, in which case
+//          it keeps other threads out instead.
+//------------------------------------------------------
+void lockPool()
+{
+  PoolState* const pool = currentPool();
+  if(numObjMngrs != 0 && (pool->shared || threadSafe || numShards > 0))
+  {
+    // a process died holding the lock; the pool is as it left it,
+    // which is all we can go on
+    if(pthread_mutex_lock(&(pool->lock)) == EOWNERDEAD)
     {
-      prev = curr;
-      curr = curr->next;
+      pthread_mutex_consistent(&(pool->lock));
     }
-    // insert node
-    prev->next = aNode;
   }
-  checkIndex(indexing);
-} //end of insertAtEnd()
+} // end of lockPool()
 
 //------------------------------------------------------
-// compact
+// unlockPool
 //
-// PURPOSE: this function initiates garbage collection.
-//          Reference Counting technique is used as a way
-//          of determining which objects are garbage.
-//          Defragmentation is handled by double buffering.
-//          To keep code clean, this function calls various
-//          other private functions to carry out the
-//          individual tasks.
+// PURPOSE: lets other processes use a shared pool again,
+//          once for every call to lockPool.
 //------------------------------------------------------
-static void compact()
+void unlockPool()
 {
-  checkIndex(indexing);
-  printf("\nGarbage collector statistics:\n");
-
-  //step1: copy nongarbage from active to inactive buffer
-  copyActToNonact();
+  PoolState* const pool = currentPool();
+  if(numObjMngrs != 0 && (pool->shared || threadSafe || numShards > 0))
+  {
+    pthread_mutex_unlock(&(pool->lock));
+  }
+} // end of unlockPool()
 
-  //step2: swap buffers
-  swapBuffers();
+//------------------------------------------------------
+// lockShardOf
+//
+// PURPOSE: keeps other threads from using the shard of a
+//          sharded pool an object is in until unlockShardOf
+//          is called, so a pointer from retrieveObject stays
+//          valid. Only that shard's collections move it.
+//          Calls can be nested; for a pool that isn't
+//          sharded this is lockPool.
+//
+// INPUT PARAMETERS:
+// ref - the object
+//------------------------------------------------------
+void lockShardOf(Ref ref)
+{
+  Shard* previous = enterShard(ref);
+  lockPool();
+  leaveShard(previous);
+} // end of lockShardOf()
 
-  //step3: update index keeping track of objects
-  updateIndex();
-  checkIndex(indexing);
+//------------------------------------------------------
+// unlockShardOf
+//
+// PURPOSE: lets other threads use the shard of an object
+//          again, once for every call to lockShardOf.
+//
+// INPUT PARAMETERS:
+// ref - the object
+//------------------------------------------------------
+void unlockShardOf(Ref ref)
+{
+  Shard* previous = enterShard(ref);
+  unlockPool();
+  leaveShard(previous);
+} // end of unlockShardOf()
 
-}// end of compact()
+//------------------------------------------------------
+// currentPool
+//
+// PURPOSE: finds the state of the pool the current call works
+//          on: the shard the calling thread has entered, if
+//          any, the pool in use otherwise. Functions look it
+//          up once, after entering the shard they work on.
+//
+// RETURN:
+// the state of the pool to work on
+//------------------------------------------------------
+static PoolState* currentPool()
+{
+  return (threadShard != NULL) ? &(threadShard->state) : mainPool;
+} // end of currentPool()
 
 //------------------------------------------------------
-// updateIndex
+// enterShard
 //
-// PURPOSE: when garbage collection is initiated, this function
-//          helps update the index linked list to clean up
-//          and remove objects with a ref count of 0 after
-//          the buffers have been dealt with already.
+// PURPOSE: makes the shard of a sharded pool an object is in
+//          the one the calling thread works on, so pool
+//          means that shard's state until leaveShard. Does
+//          nothing for a pool that isn't sharded.
+//
+// INPUT PARAMETERS:
+// ref - the object (refs past the last shard go to the first)
 //
+// RETURN:
+// the shard worked on before, to be given to leaveShard
 //------------------------------------------------------
-static void updateIndex()
+static Shard* enterShard(Ref ref)
 {
-  checkIndex(indexing);
+  Shard* previous = threadShard;
+  if(numShards > 0)
+  {
+    int shard = SHARD_OF(ref);
+    threadShard = &(shards[(shard < numShards) ? shard : 0]);
+  }
+  return previous;
+} // end of enterShard()
 
-  // clean until index has objects with a ref count of 0
-  while(garbageExists() == 1)
+//------------------------------------------------------
+// enterHomeShard
+//
+// PURPOSE: like enterShard, for the shard the calling
+//          thread allocates from (see setHomeShard)
+//
+// RETURN:
+// the shard worked on before, to be given to leaveShard
+//------------------------------------------------------
+static Shard* enterHomeShard()
+{
+  Shard* previous = threadShard;
+  if(numShards > 0)
   {
-    Node* curr = indexing->top;
-    Node* prev = NULL;
-    // finding the first occurence of a node with 0 references
-    while(curr->objReferenceCount != 0)
-    {
-      prev = curr;
-      curr = curr->next;
-    }
-    // if there is only a single node in the list
-    if (indexing->top->next == NULL)
-    {
-      indexing->top = NULL;
-    }
-    else
+    int shard = homeShard;
+    if(shard < 0)
     {
-      if(prev == NULL) //removing from front
-      {
-        indexing->top = curr->next;
-      }
-      else //removing from back or middle
-      {
-        prev->next = curr->next;
-      }
+      int cpu = sched_getcpu();
+      shard = (cpu >= 0) ? cpu : 0;
     }
-    checkIndex(indexing);
+    threadShard = &(shards[shard % numShards]);
   }
-  checkIndex(indexing);
-}// end of updateIndex()
+  return previous;
+} // end of enterHomeShard()
+
+//------------------------------------------------------
+// leaveShard
+//
+// PURPOSE: goes back to the shard worked on before the
+//          matching enterShard or enterHomeShard
+//
+// INPUT PARAMETERS:
+// previous - what enterShard returned
+//------------------------------------------------------
+static void leaveShard(Shard* previous)
+{
+  threadShard = previous;
+} // end of leaveShard()
+
+//------------------------------------------------------
+// inOtherShard
+//
+// PURPOSE: tells whether a ref found in an object of the
+//          shard being worked on is in another shard, whose
+//          counts mustn't be touched without its lock.
+//
+// INPUT PARAMETERS:
+// ref - the ref, may be NULL_REF
+//
+// RETURN:
+// 1 if it is in another shard, 0 otherwise
+//------------------------------------------------------
+static int inOtherShard(Ref ref)
+{
+  return (ref != NULL_REF && threadShard != NULL && SHARD_OF(ref) != (int)(threadShard - shards));
+} // end of inOtherShard()
+
+//------------------------------------------------------
+// queueShardChange
+//
+// PURPOSE: sends a reference count change to the shard an
+//          object is in, which applies it at its next
+//          garbage collection (see applyShardInbox). Only
+//          the inbox is locked, so the shard being worked on
+//          can stay locked while this waits.
+//
+// INPUT PARAMETERS:
+// ref - the object whose count changes
+// delta - +1 or -1
+//------------------------------------------------------
+static void queueShardChange(Ref ref, int delta)
+{
+  assert(numShards > 0 && SHARD_OF(ref) < numShards);
+  if(SHARD_OF(ref) < numShards)
+  {
+    Shard* target = &(shards[SHARD_OF(ref)]);
+    pthread_mutex_lock(&(target->inboxLock));
+    if(target->inboxLength == target->inboxCapacity)
+    {
+      target->inbox = (RefLogEntry*)growArray(target->inbox, &(target->inboxCapacity), sizeof(RefLogEntry));
+    }
+    target->inbox[target->inboxLength].ref = ref;
+    target->inbox[target->inboxLength].delta = delta;
+    target->inbox[target->inboxLength].sequence = target->inboxLength;
+    target->inboxLength++;
+    pthread_mutex_unlock(&(target->inboxLock));
+  }
+} // end of queueShardChange()
+
+//------------------------------------------------------
+// applyShardInbox
+//
+// PURPOSE: applies the count changes other shards sent the
+//          shard being worked on, in the order they were
+//          sent. An increment is only ever sent while another
+//          reference from the same shard still holds the
+//          object, and that one's drop comes after it, so
+//          applying them late never lets a count reach 0 too
+//          early.
+//------------------------------------------------------
+static void applyShardInbox()
+{
+  PoolState* const pool = currentPool();
+  if(threadShard != NULL)
+  {
+    pthread_mutex_lock(&(threadShard->inboxLock));
+    RefLogEntry* changes = threadShard->inbox;
+    int numChanges = threadShard->inboxLength;
+    threadShard->inbox = NULL;
+    threadShard->inboxLength = 0;
+    threadShard->inboxCapacity = 0;
+    pthread_mutex_unlock(&(threadShard->inboxLock));
+
+    int length = 0;
+    Node** table = (numChanges > 0) ? makeNodeTable(&length) : NULL;
+    for(int i = 0; i < numChanges; i++)
+    {
+      Node* target = searchNodeTable(table, length, changes[i].ref);
+      if(target != NULL && target->objReferenceCount != 0)
+      {
+        if(changes[i].delta < 0)
+        {
+          pool->reserveBackoff = 0;
+        }
+        target->objReferenceCount = target->objReferenceCount + changes[i].delta;
+        if(target->objReferenceCount == 0)
+        {
+          pool->deadBytes = pool->deadBytes + target->memSize;
+        }
+      }
+    }
+    free(table);
+    free(changes);
+  }
+} // end of applyShardInbox()
+
+//------------------------------------------------------
+// mapBuffers
+//
+// PURPOSE: maps anonymous memory for both buffers, one
+//          after the other, each taking up bufferMapSize
+//          bytes. Mapping rather than allocating the buffers
+//          lets loadPool map a pool image over the start of a
+//          buffer, and mapping them together means both are
+//          backed by the same kind of pages.
+//          With huge pages requested, explicit huge pages are
+//          tried first, then transparent huge pages, then
+//          normal pages, and pool->hugePages is lowered to
+//          whatever worked. Transparent huge pages are only
+//          used for 2MB aligned memory, so a bit more is
+//          mapped and the ends are trimmed off to align it.
+//
+// RETURN:
+// a pointer to the first buffer, NULL if they couldn't be mapped
+//------------------------------------------------------
+static uchar* mapBuffers()
+{
+  PoolState* const pool = currentPool();
+  void* buffers = MAP_FAILED;
+  ulong hugeSize = roundUp(MEMORY_SIZE, HUGE_PAGE_SIZE);
+
+#ifdef MAP_HUGETLB
+  if(pool->hugePages == HUGE_PAGES_EXPLICIT)
+  {
+    buffers = mmap(NULL, 2 * hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if(buffers == MAP_FAILED && pool->hugePages == HUGE_PAGES_EXPLICIT)
+  {
+    // no huge pages reserved, see if the kernel will make them for us
+    pool->hugePages = HUGE_PAGES_TRANSPARENT;
+  }
+
+#ifdef MADV_HUGEPAGE
+  if(buffers == MAP_FAILED && pool->hugePages == HUGE_PAGES_TRANSPARENT)
+  {
+    void* region = mmap(NULL, 2 * hugeSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(region != MAP_FAILED)
+    {
+      uchar* start = (uchar*)region;
+      uchar* aligned = (uchar*)roundUp((ulong)start, HUGE_PAGE_SIZE);
+      uchar* end = aligned + 2 * hugeSize;
+      if(aligned > start)
+      {
+        munmap(start, aligned - start);
+      }
+      if(start + 2 * hugeSize + HUGE_PAGE_SIZE > end)
+      {
+        munmap(end, (start + 2 * hugeSize + HUGE_PAGE_SIZE) - end);
+      }
+      if(madvise(aligned, 2 * hugeSize, MADV_HUGEPAGE) == 0)
+      {
+        buffers = aligned;
+      }
+      else
+      {
+        munmap(aligned, 2 * hugeSize);
+      }
+    }
+  }
+#endif
+  if(buffers == MAP_FAILED)
+  {
+    pool->hugePages = HUGE_PAGES_NONE;
+    buffers = mmap(NULL, 2 * pageAlign(MEMORY_SIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  pool->bufferMapSize = (pool->hugePages == HUGE_PAGES_NONE) ? pageAlign(MEMORY_SIZE) : hugeSize;
+  pool->bufferPageSize = (pool->hugePages == HUGE_PAGES_EXPLICIT) ? HUGE_PAGE_SIZE : pageAlign(1);
+  return (buffers == MAP_FAILED) ? NULL : (uchar*)buffers;
+} // end of mapBuffers()
+
+//------------------------------------------------------
+// unmapBuffers
+//
+// PURPOSE: gives the buffers made by mapBuffers back to the
+//          system, along with any image mapped over them.
+//          They may have been swapped, so the mapping starts
+//          at whichever comes first.
+//------------------------------------------------------
+static void unmapBuffers()
+{
+  PoolState* const pool = currentPool();
+  assert(pool->activeBuffer != NULL);
+  assert(pool->inactiveBuffer != NULL);
+  uchar* first = (pool->activeBuffer < pool->inactiveBuffer) ? pool->activeBuffer : pool->inactiveBuffer;
+  munmap(first, 2 * pool->bufferMapSize);
+} // end of unmapBuffers()
+
+//------------------------------------------------------
+// pageAlign
+//
+// PURPOSE: rounds a number of bytes up to a whole number of
+//          pages
+//
+// INPUT PARAMETERS:
+// numBytes - the number of bytes to round up
+//
+// RETURN:
+// the rounded number of bytes
+//------------------------------------------------------
+static ulong pageAlign(ulong numBytes)
+{
+  return roundUp(numBytes, (ulong)sysconf(_SC_PAGESIZE));
+} // end of pageAlign()
+
+//------------------------------------------------------
+// roundUp
+//
+// PURPOSE: rounds a number up to a multiple of another
+//
+// INPUT PARAMETERS:
+// numBytes - the number to round up
+// multiple - what it is rounded up to a multiple of
+//
+// RETURN:
+// the rounded number
+//------------------------------------------------------
+static ulong roundUp(ulong numBytes, ulong multiple)
+{
+  return (numBytes + multiple - 1) / multiple * multiple;
+} // end of roundUp()
+
+//------------------------------------------------------
+// setHugePages
+//
+// PURPOSE: chooses the pages backing the buffers of pools
+//          initialised from now on.
+//
+// INPUT PARAMETERS:
+// mode - HUGE_PAGES_NONE, HUGE_PAGES_TRANSPARENT or
+//        HUGE_PAGES_EXPLICIT
+//------------------------------------------------------
+void setHugePages(int mode)
+{
+  assert(mode == HUGE_PAGES_NONE || mode == HUGE_PAGES_TRANSPARENT || mode == HUGE_PAGES_EXPLICIT);
+  if(mode == HUGE_PAGES_NONE || mode == HUGE_PAGES_TRANSPARENT || mode == HUGE_PAGES_EXPLICIT)
+  {
+    hugePagesRequested = mode;
+  }
+} // end of setHugePages()
+
+//------------------------------------------------------
+// getHugePages
+//
+// PURPOSE: reports the pages the buffers of the pool in
+//          use are backed by, which may be less than was
+//          asked for if huge pages weren't available.
+//
+// RETURN:
+// HUGE_PAGES_NONE, HUGE_PAGES_TRANSPARENT or HUGE_PAGES_EXPLICIT
+//------------------------------------------------------
+int getHugePages()
+{
+  PoolState* const pool = currentPool();
+  return (numObjMngrs != 0) ? pool->hugePages : HUGE_PAGES_NONE;
+} // end of getHugePages()
+
+//------------------------------------------------------
+// destroyPool
+//
+// PURPOSE: cleans up all the memory being used by the
+//          Object manager.
+//
+// (No return type or input/output parameters)
+//------------------------------------------------------
+void destroyPool()
+{
+  PoolState* const pool = currentPool();
+  // if there is actually an object manager initialised that needs to cleaned up
+  if(numObjMngrs != 0)
+  {
+    // check all resources are valid before destroying
+    assert(pool->activeBuffer != NULL);
+    assert(pool->inactiveBuffer != NULL);
+    checkIndex(pool->indexing);
+    if(numShards > 0)
+    {
+      destroyShards();
+    }
+    else if(pool->shared)
+    {
+      // the pool goes when the last process lets go of it
+      detachSharedPool();
+    }
+    else
+    {
+      // clean up memory being used
+      unmapBuffers();
+      pool->activeBuffer = NULL;
+      pool->inactiveBuffer = NULL;
+      destroyIndex(pool->indexing);
+      invalidateTranslationCache();
+    }
+    numObjMngrs--;
+    // roots belonged to the objects of this pool
+    free(roots);
+    roots = NULL;
+    numRoots = 0;
+    rootsCapacity = 0;
+    free(rootSlots);
+    rootSlots = NULL;
+    numRootSlots = 0;
+    rootSlotsCapacity = 0;
+  }
+} // end of destroyPool()
+
+//------------------------------------------------------
+// savePool
+//
+// PURPOSE: writes the memory pool to a file from which
+//          loadPool can bring it back. Garbage is collected
+//          first, so only the used part of the compacted
+//          active buffer is written, along with a record of
+//          each object in the index. The buffer contents start
+//          on a page boundary in the file so loadPool can map
+//          them straight into memory.
+//
+// INPUT PARAMETERS:
+// path - the file to write the pool image to
+//
+// RETURN:
+// 1 if the image was written, 0 otherwise
+//------------------------------------------------------
+int savePool(const char* path)
+{
+  PoolState* const pool = currentPool();
+  assert(numObjMngrs != 0);
+  int saved = 0;
+
+  // an image holds one buffer and index, which a sharded pool doesn't have
+  if(numObjMngrs != 0 && path != NULL && numShards == 0)
+  {
+    lockPool();
+    compact();
+    FILE* image = fopen(path, "wb");
+    if(image != NULL)
+    {
+      PoolImageHeader header;
+      header.magic = POOL_IMAGE_MAGIC;
+      header.memorySize = MEMORY_SIZE;
+      header.referenceID = pool->referenceID;
+      header.numObjects = 0;
+      for(Node* curr = pool->indexing->top; curr != NULL; curr = curr->next)
+      {
+        header.numObjects++;
+      }
+      header.usedBytes = pool->nextAvailableIndex;
+      header.dataOffset = pageAlign(sizeof(PoolImageHeader) + header.numObjects * sizeof(PoolImageRecord));
+
+      int ok = (fwrite(&header, sizeof(PoolImageHeader), 1, image) == 1);
+      for(Node* curr = pool->indexing->top; curr != NULL && ok; curr = curr->next)
+      {
+        PoolImageRecord record;
+        record.ref = curr->objReferenceID;
+        record.memStartIndex = curr->isClone ? curr->storage->memStartIndex : curr->memStartIndex;
+        record.memSize = curr->memSize;
+        record.refSlotCount = curr->refSlotCount;
+        record.objReferenceCount = curr->objReferenceCount;
+        record.storageRef = curr->isClone ? curr->storage->objReferenceID : NULL_REF;
+        record.hidden = curr->hidden;
+        ok = (fwrite(&record, sizeof(PoolImageRecord), 1, image) == 1);
+      }
+      // pad up to the page boundary where the buffer contents go
+      ok = ok && (fseek(image, header.dataOffset, SEEK_SET) == 0);
+      ok = ok && (fwrite(pool->activeBuffer, 1, header.usedBytes, image) == header.usedBytes);
+      saved = (fclose(image) == 0) && ok;
+    }
+    if(!saved)
+    {
+      printf("Unable to save the memory pool to %s\n", path);
+    }
+    unlockPool();
+  }
+  else if(numShards > 0)
+  {
+    printf("A sharded memory pool can't be saved.\n");
+  }
+  return saved;
+} // end of savePool()
+
+//------------------------------------------------------
+// loadPool
+//
+// PURPOSE: initialises the object manager from a file
+//          written by savePool. The buffer contents in the
+//          file are mapped copy-on-write over the start of
+//          the active buffer, so nothing is read until an
+//          object is used, and changes never reach the file.
+//          The index is rebuilt from the object records, so
+//          every reference handed out before the pool was
+//          saved still refers to the same object.
+//
+// INPUT PARAMETERS:
+// path - the file to read the pool image from
+//
+// RETURN:
+// 1 if the pool was loaded, 0 otherwise (no object manager is
+// initialised in that case)
+//------------------------------------------------------
+int loadPool(const char* path)
+{
+  PoolState* const pool = currentPool();
+  int loaded = 0;
+
+  if(numObjMngrs == 0 && path != NULL)
+  {
+    int fd = open(path, O_RDONLY);
+    PoolImageHeader header;
+    int ok = (fd >= 0 && pread(fd, &header, sizeof(PoolImageHeader), 0) == (ssize_t)sizeof(PoolImageHeader));
+    ok = ok && header.magic == POOL_IMAGE_MAGIC && header.memorySize == MEMORY_SIZE;
+    ok = ok && header.usedBytes <= MEMORY_SIZE && header.referenceID > header.numObjects;
+
+    if(ok)
+    {
+      setUpPool();
+      // lay the image over the start of the active buffer
+      if(header.usedBytes > 0)
+      {
+        void* mapped = MAP_FAILED;
+        // a file can't be mapped over part of an explicit huge page
+        if(pool->hugePages != HUGE_PAGES_EXPLICIT)
+        {
+          mapped = mmap(pool->activeBuffer, pageAlign(header.usedBytes), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_FIXED, fd, header.dataOffset);
+        }
+        ok = (mapped != MAP_FAILED);
+        if(!ok)
+        {
+          ok = (pread(fd, pool->activeBuffer, header.usedBytes, header.dataOffset) == (ssize_t)header.usedBytes);
+        }
+      }
+
+      // rebuild the index. makeNode hands out the next reference id at
+      // the next available index, so point those at the object first
+      Ref lastRef = NULL_REF;
+      for(ulong i = 0; i < header.numObjects && ok; i++)
+      {
+        PoolImageRecord record;
+        off_t where = sizeof(PoolImageHeader) + i * sizeof(PoolImageRecord);
+        ok = (pread(fd, &record, sizeof(PoolImageRecord), where) == (ssize_t)sizeof(PoolImageRecord));
+        ok = ok && record.ref > lastRef && record.ref < header.referenceID;
+        ok = ok && record.memSize > 0 && record.memStartIndex + record.memSize <= header.usedBytes;
+        ok = ok && record.refSlotCount <= record.memSize / sizeof(Ref) && record.objReferenceCount > 0;
+        if(ok)
+        {
+          pool->referenceID = record.ref;
+          pool->nextAvailableIndex = record.memStartIndex;
+          Node* loadedNode = makeNode(record.memSize);
+          loadedNode->refSlotCount = record.refSlotCount;
+          loadedNode->objReferenceCount = record.objReferenceCount;
+          loadedNode->hidden = (record.hidden != 0);
+          insertAtEnd(loadedNode);
+          lastRef = record.ref;
+        }
+      }
+      pool->referenceID = header.referenceID;
+      pool->nextAvailableIndex = header.usedBytes;
+
+      // clones can only be linked to their storage once all nodes are back
+      int length = 0;
+      Node** table = ok ? makeNodeTable(&length) : NULL;
+      for(ulong i = 0; i < header.numObjects && ok; i++)
+      {
+        PoolImageRecord record;
+        off_t where = sizeof(PoolImageHeader) + i * sizeof(PoolImageRecord);
+        ok = (pread(fd, &record, sizeof(PoolImageRecord), where) == (ssize_t)sizeof(PoolImageRecord));
+        if(ok && record.storageRef != NULL_REF)
+        {
+          Node* clone = searchNodeTable(table, length, record.ref);
+          Node* storage = searchNodeTable(table, length, record.storageRef);
+          ok = (clone != NULL && storage != NULL && storage->hidden && !clone->hidden && storage->memSize == clone->memSize);
+          if(ok)
+          {
+            clone->isClone = 1;
+            clone->storage = storage;
+          }
+        }
+      }
+      free(table);
+
+      if(ok)
+      {
+        checkIndex(pool->indexing);
+        loaded = 1;
+      }
+      else
+      {
+        destroyPool();
+      }
+    }
+    if(fd >= 0)
+    {
+      // the mapping stays valid once the file is closed
+      close(fd);
+    }
+    if(!loaded)
+    {
+      printf("Unable to load a memory pool from %s\n", path);
+    }
+  }
+  else if(numObjMngrs != 0)
+  {
+    printf("\nThere is an Object Manager initialised already!\n");
+  }
+  return loaded;
+} // end of loadPool()
+
+//------------------------------------------------------
+// insertObject
+//
+// PURPOSE: This function trys to allocate a block of given
+//          size from our buffer. It will fire the garbage
+//          collector as required.
+//
+// INPUT PARAMETERS:
+// size - the amount of bytes being requested for allocation
+//        for an object
+//
+// RETURN:
+// if memory is allocated successfully, it returns the reference
+// number for the block of memory allocated for the object.
+// Otherwise, it returns NULL_REF (0)
+//------------------------------------------------------
+Ref insertObject(ulong size)
+{
+  // a plain object is one without any ref fields
+  return insertObjectWithRefs(size, 0);
+} // end of insertObject()
+
+//------------------------------------------------------
+// insertObjectWithRefs
+//
+// PURPOSE: This function trys to allocate a block of given
+//          size from our buffer whose first refSlotCount
+//          words are ref fields. It will fire the garbage
+//          collector as required. The ref fields start out
+//          as NULL_REF.
+//
+// INPUT PARAMETERS:
+// size - the amount of bytes being requested for allocation
+//        for an object
+// refSlotCount - number of ref fields at the start of the
+//                object
+//
+// RETURN:
+// if memory is allocated successfully, it returns the reference
+// number for the block of memory allocated for the object.
+// Otherwise, it returns NULL_REF (0)
+//------------------------------------------------------
+Ref insertObjectWithRefs(ulong size, ulong refSlotCount)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterHomeShard();
+  Ref returnRef = NULL_REF;
+
+  if(numObjMngrs != 0)
+  {
+    lockPool();
+    returnRef = insertInPool(size, refSlotCount);
+    unlockPool();
+  }
+  else
+  {
+    printf("There are no object managers initialised. Initialise an object manager to gain access to memory.\n");
+  }
+  leaveShard(previous);
+  return returnRef;
+} // end of insertObjectWithRefs()
+
+//------------------------------------------------------
+// insertObjectUnlocked
+//
+// PURPOSE: insertObject for a caller that locks the pool
+//          itself, or whose pool is never locked (see
+//          ObjectPool.h). Sharded pools aren't supported.
+//
+// INPUT PARAMETERS:
+// size - the amount of bytes being requested for allocation
+//        for an object
+//
+// RETURN:
+// the reference number of the object, NULL_REF (0) if it
+// couldn't be allocated or the pool is sharded
+//------------------------------------------------------
+Ref insertObjectUnlocked(ulong size)
+{
+  assert(numObjMngrs != 0 && numShards == 0);
+  Ref returnRef = NULL_REF;
+  if(numObjMngrs != 0 && numShards == 0)
+  {
+    returnRef = insertInPool(size, 0);
+  }
+  return returnRef;
+} // end of insertObjectUnlocked()
+
+//------------------------------------------------------
+// insertInPool
+//
+// PURPOSE: allocates an object in the pool (or shard) being
+//          worked on, firing the garbage collector as
+//          required. The caller holds the pool.
+//
+// INPUT PARAMETERS:
+// size - the amount of bytes being requested for allocation
+//        for an object
+// refSlotCount - number of ref fields at the start of the
+//                object
+//
+// RETURN:
+// the reference number of the object, NULL_REF (0) if it
+// couldn't be allocated
+//------------------------------------------------------
+static Ref insertInPool(ulong size, ulong refSlotCount)
+{
+  PoolState* const pool = currentPool();
+  // size cannot be negative
+  assert(size >= 0);
+  Ref returnRef = NULL_REF;
+
+  //nothing is allocated if 0 bytes, more than total memory
+  //available, or too little for the ref fields is requested
+  if (size > 0 && size <= MEMORY_SIZE && refSlotCount <= size / sizeof(Ref))
+  {
+    // if there is no room available on the buffer for the requested amount,
+    // no node left for it, or enough garbage has built up that we'd
+    // rather collect it now
+    // the emergency reserve is kept back from ordinary inserts
+    ulong limit = MEMORY_SIZE - emergencyReserve;
+    // in the reserve, collecting again can't make room until something
+    // has been let go of (tracing can't tell, so it always collects)
+    if(pool->reserveBackoff && numShards > 0)
+    {
+      applyShardInbox();
+    }
+    int collectable = (!pool->reserveBackoff || (ulong)pool->nextAvailableIndex <= limit
+                       || collectionMode != COLLECT_REFERENCE_COUNTING);
+    if((!roomFor(size, limit, 1) && collectable) || (triggerDeadPercent > 0 && collectionDue(triggerDeadPercent)))
+    {
+      //fire garbage collection
+      compact();
+    }
+
+    // ask the program to let go of something, for as long as it has
+    // something to give; the pool is unlocked so it can drop references
+    // in any shard
+    int retries = 0;
+    int released = 1;
+    while(!roomFor(size, limit, 1) && lowMemoryCallback != NULL && !inLowMemoryCallback
+          && released && retries < LOW_MEMORY_RETRIES)
+    {
+      retries++;
+      inLowMemoryCallback = 1;
+      unlockPool();
+      released = lowMemoryCallback(size, lowMemoryContext);
+      lockPool();
+      inLowMemoryCallback = 0;
+      if(released)
+      {
+        compact();
+      }
+    }
+
+    // last resort, the emergency reserve
+    if(!roomFor(size, limit, 1) && roomFor(size, MEMORY_SIZE, 1))
+    {
+      TRACEPOINT(EVENT_LOW_MEMORY, low_memory, size, (ulong)pool->nextAvailableIndex);
+    }
+
+    // check if enough space available (after garbage collecting if it fired)
+    if(roomFor(size, MEMORY_SIZE, 1))
+    {
+      //allocate memory and update index
+      returnRef = pool->referenceID;
+      Node* insertNode = makeNode(size);
+      insertNode->refSlotCount = refSlotCount;
+      // site names live in this process only, so shared pools aren't
+      // profiled, and a profile is of one index, so sharded ones aren't either
+      if(profileSamplePeriod != 0 && !pool->shared && numShards == 0)
+      {
+        profileTicker++;
+        if(profileTicker >= profileSamplePeriod)
+        {
+          profileTicker = 0;
+          insertNode->site = allocationSite;
+        }
+      }
+      pool->bytesSinceCollection = pool->bytesSinceCollection + size;
+      memset(&(pool->activeBuffer[insertNode->memStartIndex]), 0, refSlotCount * sizeof(Ref));
+      checkNode(insertNode);
+      insertAtEnd(insertNode);
+    }
+    else
+    {
+      TRACEPOINT(EVENT_ALLOC_FAILURE, alloc_failure, size, (ulong)pool->nextAvailableIndex);
+    }
+    pool->reserveBackoff = ((ulong)pool->nextAvailableIndex > limit);
+  }
+  checkIndex(pool->indexing);
+  traceOperation(TRACE_INSERT, returnRef, size, refSlotCount);
+  return returnRef;
+} // end of insertInPool()
+
+//------------------------------------------------------
+// roomFor
+//
+// PURPOSE: tells whether some bytes fit at the end of the
+//          buffer below a limit on the used part of it, with
+//          the nodes they need
+//
+// INPUT PARAMETERS:
+// size - bytes asked for
+// limit - the most of the buffer that may be used
+// numNodes - nodes needed as well (1 for an insert, 0 when
+//            an object grows)
+//
+// RETURN:
+// 1 if it fits, 0 otherwise
+//------------------------------------------------------
+static int roomFor(ulong size, ulong limit, int numNodes)
+{
+  PoolState* const pool = currentPool();
+  ulong used = pool->nextAvailableIndex;
+  return (used <= limit && size <= limit - used && nodesAvailable(numNodes));
+} // end of roomFor()
+
+//------------------------------------------------------
+// insertAtEnd
+//
+// PURPOSE: inserts a Node at the end of the object manager's
+//          index (i.e. the linked list)
+//
+// INPUT PARAMETERS:
+// aNode - the node being inserted in the index
+//------------------------------------------------------
+static void insertAtEnd(Node* aNode)
+{
+  PoolState* const pool = currentPool();
+  checkIndex(pool->indexing);
+  checkNode(aNode);
+
+  // case 1: index is empty
+  if(pool->indexing->top == NULL)
+  {
+    pool->indexing->top = aNode;
+  }   
+  else
+  {
+    // case 2: index not empty, insert after the last node
+    pool->indexing->last->next = aNode;
+  }
+  pool->indexing->last = aNode;
+  checkIndex(pool->indexing);
+} //end of insertAtEnd()
+
+//------------------------------------------------------
+// resizeObject
+//
+// PURPOSE: changes the size of an object, keeping its
+//          reference. An object that shrinks stays where it
+//          is. An object that grows is extended in place if
+//          it is at the end of the used part of the buffer,
+//          or if the blocks right after it are garbage, and
+//          is otherwise moved to the end of the buffer (after
+//          garbage collecting, if that's what it takes to make
+//          room). The contents are kept, up to the smaller of
+//          the two sizes; any new bytes are not cleared.
+//
+// INPUT PARAMETERS:
+// ref - the object being resized
+// newSize - the number of bytes the object should have
+//
+// RETURN:
+// 1 if the object was resized, 0 otherwise (the object is left
+// as it was)
+//------------------------------------------------------
+int resizeObject(Ref ref, ulong newSize)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  PoolState* const pool = currentPool();
+  int resized = 0;
+
+  if(numObjMngrs != 0 && ref != NULL_REF && newSize > 0 && newSize <= MEMORY_SIZE)
+  {
+    lockPool();
+    traceOperation(TRACE_RESIZE, ref, newSize, 0);
+    Node* target = findNode(ref);
+    // a clone needs contents of its own to resize
+    if(target != NULL && target->objReferenceCount != 0 && target->isClone)
+    {
+      target = ownContents(ref) ? findNode(ref) : NULL;
+    }
+    // the ref fields have to fit in the new size
+    if(target != NULL && target->objReferenceCount != 0 && target->refSlotCount <= newSize / sizeof(Ref))
+    {
+      checkNode(target);
+      // the emergency reserve is kept back from objects growing too
+      ulong limit = MEMORY_SIZE - emergencyReserve;
+      ulong oldSize = target->memSize;
+      int atTail = (target->memStartIndex + oldSize == (ulong)pool->nextAvailableIndex);
+
+      if(newSize <= oldSize)
+      {
+        // the bytes given up are garbage, unless we can just rewind
+        if(atTail)
+        {
+          pool->nextAvailableIndex = target->memStartIndex + newSize;
+        }
+        else
+        {
+          pool->deadBytes = pool->deadBytes + (oldSize - newSize);
+          pool->reserveBackoff = 0;
+        }
+        target->memSize = newSize;
+        resized = 1;
+      }
+      else if(atTail && target->memStartIndex + newSize <= limit)
+      {
+        pool->nextAvailableIndex = target->memStartIndex + newSize;
+        target->memSize = newSize;
+        resized = 1;
+      }
+      else
+      {
+        resized = absorbDeadBlocks(target, newSize, limit);
+      }
+
+      // move the object to the end of the buffer, collecting garbage first
+      // if that's what it takes to stay out of the emergency reserve
+      if(!resized)
+      {
+        resized = growAtEnd(target, newSize, limit);
+      }
+      if(!resized)
+      {
+        //fire garbage collection
+        compact();
+        // in tracing mode the object is gone if it wasn't reachable
+        target = findNode(ref);
+        if(target != NULL && target->objReferenceCount != 0)
+        {
+          resized = growAtEnd(target, newSize, limit);
+          // last resort, the emergency reserve
+          if(!resized && growAtEnd(target, newSize, MEMORY_SIZE))
+          {
+            TRACEPOINT(EVENT_LOW_MEMORY, low_memory, newSize, (ulong)pool->nextAvailableIndex);
+            resized = 1;
+          }
+        }
+      }
+
+      if(resized && newSize > oldSize)
+      {
+        pool->bytesSinceCollection = pool->bytesSinceCollection + (newSize - oldSize);
+        raiseHighWater();
+      }
+    }
+    checkIndex(pool->indexing);
+    unlockPool();
+  }
+  leaveShard(previous);
+  return resized;
+} // end of resizeObject()
+
+//------------------------------------------------------
+// growAtEnd
+//
+// PURPOSE: grows an object at the end of the used part of
+//          the buffer: where it is if it is the last object
+//          there, otherwise by moving it to the end. The
+//          block it leaves behind is garbage.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object being grown
+// newSize - the number of bytes the object should have
+// limit - the most of the buffer that may be used
+//
+// RETURN:
+// 1 if the object was grown, 0 otherwise (nothing is changed)
+//------------------------------------------------------
+static int growAtEnd(Node* aNode, ulong newSize, ulong limit)
+{
+  PoolState* const pool = currentPool();
+  ulong oldSize = aNode->memSize;
+  int grown = 0;
+
+  if(aNode->memStartIndex + oldSize == (ulong)pool->nextAvailableIndex && aNode->memStartIndex + newSize <= limit)
+  {
+    pool->nextAvailableIndex = aNode->memStartIndex + newSize;
+    aNode->memSize = newSize;
+    grown = 1;
+  }
+  else if(roomFor(newSize, limit, 0))
+  {
+    memcpy(&(pool->activeBuffer[pool->nextAvailableIndex]), &(pool->activeBuffer[aNode->memStartIndex]), oldSize);
+    pool->deadBytes = pool->deadBytes + oldSize;
+    aNode->memStartIndex = pool->nextAvailableIndex;
+    aNode->memSize = newSize;
+    pool->nextAvailableIndex = pool->nextAvailableIndex + newSize;
+    grown = 1;
+  }
+  return grown;
+} // end of growAtEnd()
+
+//------------------------------------------------------
+// absorbDeadBlocks
+//
+// PURPOSE: grows an object into the garbage blocks that
+//          directly follow it in the buffer, if there are
+//          enough of them to make room. The garbage blocks
+//          are reclaimed on the spot: they let go of their
+//          ref fields and their nodes are removed from the
+//          index. Whatever is left over of the last block is
+//          a hole the next garbage collection closes. If the
+//          garbage runs up to the end of the used part of the
+//          buffer, the object can grow past it as well, up to
+//          a limit. Only reference counting knows what is
+//          garbage between collections.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object being grown
+// newSize - the number of bytes the object should have
+// limit - the most of the buffer that may be used
+//
+// RETURN:
+// 1 if the object was grown in place, 0 otherwise (nothing is
+// changed)
+//------------------------------------------------------
+static int absorbDeadBlocks(Node* aNode, ulong newSize, ulong limit)
+{
+  PoolState* const pool = currentPool();
+  int absorbed = 0;
+
+  if(collectionMode == COLLECT_REFERENCE_COUNTING)
+  {
+    // the blocks the grown object would cover, in address order; the
+    // index is in reference order, so this takes one walk and a sort
+    int growStart = aNode->memStartIndex + aNode->memSize;
+    ulong growEnd = aNode->memStartIndex + newSize;
+    Node** blocks = NULL;
+    int blocksCapacity = 0;
+    int numBlocks = 0;
+    Node* curr = pool->indexing->top;
+    while(curr != NULL)
+    {
+      // clones have no place in the buffer of their own
+      if(!curr->isClone && curr->memStartIndex >= growStart && (ulong)curr->memStartIndex < growEnd)
+      {
+        if(numBlocks == blocksCapacity)
+        {
+          blocks = (Node**)(growArray(blocks, &blocksCapacity, sizeof(Node*)));
+        }
+        blocks[numBlocks] = curr;
+        numBlocks++;
+      }
+      curr = curr->next;
+    }
+    if(numBlocks > 1)
+    {
+      qsort(blocks, numBlocks, sizeof(Node*), compareStarts);
+    }
+
+    // see if enough garbage follows the object before touching any of it
+    ulong room = aNode->memSize;
+    int numTaken = 0;
+    while(room < newSize && numTaken < numBlocks && blocks[numTaken]->objReferenceCount == 0
+          && (ulong)blocks[numTaken]->memStartIndex == aNode->memStartIndex + room)
+    {
+      room = room + blocks[numTaken]->memSize;
+      numTaken++;
+    }
+
+    int reachesTail = (aNode->memStartIndex + room == (ulong)pool->nextAvailableIndex);
+
+    if(room >= newSize || (reachesTail && aNode->memStartIndex + newSize <= limit))
+    {
+      for(int i = 0; i < numTaken; i++)
+      {
+        pool->deadBytes = (pool->deadBytes > blocks[i]->memSize) ? pool->deadBytes - blocks[i]->memSize : 0;
+        releaseRefFields(blocks[i]);
+      }
+      removeNodes(blocks, numTaken);
+      invalidateTranslationCache();
+      if(room >= newSize)
+      {
+        pool->deadBytes = pool->deadBytes + (room - newSize);
+      }
+      else
+      {
+        pool->nextAvailableIndex = aNode->memStartIndex + newSize;
+      }
+      aNode->memSize = newSize;
+      absorbed = 1;
+    }
+    free(blocks);
+  }
+  return absorbed;
+} // end of absorbDeadBlocks()
+
+//------------------------------------------------------
+// removeNodes
+//
+// PURPOSE: unlinks a number of nodes from the index in one
+//          walk and destroys them. The translation cache must
+//          be invalidated after.
+//
+// INPUT PARAMETERS:
+// nodes - the nodes being removed, sorted by compareStarts
+// numNodes - how many nodes there are
+//------------------------------------------------------
+static void removeNodes(Node** nodes, int numNodes)
+{
+  PoolState* const pool = currentPool();
+  Node* curr = pool->indexing->top;
+  Node* prev = NULL;
+  int numRemoved = 0;
+  while(curr != NULL && numRemoved < numNodes)
+  {
+    Node* next = curr->next;
+    Node** found = (Node**)(bsearch(&curr, nodes, numNodes, sizeof(Node*), compareStarts));
+    if(found != NULL && *found == curr)
+    {
+      numRemoved++;
+      if(prev == NULL) //removing from front
+      {
+        pool->indexing->top = next;
+      }
+      else //removing from back or middle
+      {
+        prev->next = next;
+      }
+      if(pool->indexing->last == curr)
+      {
+        pool->indexing->last = prev;
+      }
+      destroyNode(curr);
+    }
+    else
+    {
+      prev = curr;
+    }
+    curr = next;
+  }
+} // end of removeNodes()
+
+//------------------------------------------------------
+// compareStarts
+//
+// PURPOSE: qsort comparison function ordering nodes by where
+//          their objects start in the active buffer.
+//
+// RETURN:
+// negative, zero or positive as a orders before, with or
+// after b
+//------------------------------------------------------
+static int compareStarts(const void* a, const void* b)
+{
+  const Node* first = *(const Node* const*)a;
+  const Node* second = *(const Node* const*)b;
+  return (first->memStartIndex > second->memStartIndex) - (first->memStartIndex < second->memStartIndex);
+} // end of compareStarts()
+
+//------------------------------------------------------
+// removeNode
+//
+// PURPOSE: unlinks a node from the index and destroys it.
+//          The translation cache must be invalidated after.
+//
+// INPUT PARAMETERS:
+// aNode - the node being removed
+//------------------------------------------------------
+static void removeNode(Node* aNode)
+{
+  PoolState* const pool = currentPool();
+  Node* curr = pool->indexing->top;
+  Node* prev = NULL;
+  while(curr != NULL && curr != aNode)
+  {
+    prev = curr;
+    curr = curr->next;
+  }
+  assert(curr != NULL);
+
+  if(curr != NULL)
+  {
+    if(prev == NULL) //removing from front
+    {
+      pool->indexing->top = curr->next;
+    }
+    else //removing from back or middle
+    {
+      prev->next = curr->next;
+    }
+    if(pool->indexing->last == curr)
+    {
+      pool->indexing->last = prev;
+    }
+    destroyNode(curr);
+  }
+} // end of removeNode()
+
+//------------------------------------------------------
+// cloneObject
+//
+// PURPOSE: makes a copy of an object without copying its
+//          contents. The first time an object is cloned its
+//          contents are handed over to a hidden storage node,
+//          which the object and all its clones share, each
+//          holding a reference on it. Nothing is copied until
+//          one of them is written (see ownContents), and the
+//          contents are reclaimed once none of them use them.
+//
+// INPUT PARAMETERS:
+// ref - the object being cloned
+//
+// RETURN:
+// the reference to the clone, which the caller holds, or
+// NULL_REF if the object couldn't be cloned
+//------------------------------------------------------
+Ref cloneObject(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  PoolState* const pool = currentPool();
+  Ref cloneRef = NULL_REF;
+
+  if(numObjMngrs != 0 && ref != NULL_REF)
+  {
+    lockPool();
+    Node* source = findNode(ref);
+    int nodesNeeded = (source != NULL && !source->isClone) ? 2 : 1;
+    if(source != NULL && source->objReferenceCount != 0 && !source->hidden && nodesAvailable(nodesNeeded))
+    {
+      // makeNode puts a node at the next available index, point that at the contents
+      int nextIndex = pool->nextAvailableIndex;
+      if(!source->isClone)
+      {
+        pool->nextAvailableIndex = source->memStartIndex;
+        Node* storage = makeNode(source->memSize);
+        storage->refSlotCount = source->refSlotCount;
+        storage->hidden = 1;
+        insertAtEnd(storage);
+        // the contents and the references in its ref fields are the storage's now
+        source->isClone = 1;
+        source->storage = storage;
+      }
+
+      pool->nextAvailableIndex = source->storage->memStartIndex;
+      Node* clone = makeNode(source->memSize);
+      pool->nextAvailableIndex = nextIndex;
+      clone->refSlotCount = source->refSlotCount;
+      clone->site = source->site;
+      clone->isClone = 1;
+      clone->storage = source->storage;
+      if(collectionMode == COLLECT_REFERENCE_COUNTING)
+      {
+        clone->storage->objReferenceCount++;
+      }
+      checkNode(clone);
+      insertAtEnd(clone);
+      cloneRef = clone->objReferenceID;
+    }
+    checkIndex(pool->indexing);
+    traceOperation(TRACE_CLONE, cloneRef, ref, 0);
+    unlockPool();
+  }
+  leaveShard(previous);
+  return cloneRef;
+} // end of cloneObject()
+
+//------------------------------------------------------
+// retrieveObjectForWrite
+//
+// PURPOSE: returns a pointer to an object that may be
+//          written. A clone gets contents of its own first,
+//          so the objects it shared them with aren't changed.
+//
+// INPUT PARAMETERS:
+// ref - the reference id for the object
+//
+// RETURN:
+// a void pointer to the object, or NULL if it isn't alive or
+// there is no room for its own copy
+//------------------------------------------------------
+void* retrieveObjectForWrite(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  void* ptr = NULL;
+
+  if(numObjMngrs != 0 && ref != NULL_REF)
+  {
+    lockPool();
+    traceOperation(TRACE_RETRIEVE, ref, 0, 0);
+    traceSuspended++;
+    if(ownContents(ref))
+    {
+      ptr = retrieveObject(ref);
+    }
+    traceSuspended--;
+    unlockPool();
+  }
+  leaveShard(previous);
+  return ptr;
+} // end of retrieveObjectForWrite()
+
+//------------------------------------------------------
+// ownContents
+//
+// PURPOSE: gives a clone contents of its own. If nothing else
+//          shares its storage it simply takes the storage's
+//          block over; otherwise the contents are copied to
+//          the end of the buffer (after garbage collecting, if
+//          that's what it takes to make room outside the
+//          emergency reserve) and the clone takes a reference
+//          of its own on whatever its ref fields point at.
+//
+// INPUT PARAMETERS:
+// ref - the object that needs its own contents
+//
+// RETURN:
+// 1 if the object is alive and has contents of its own, 0
+// otherwise
+//------------------------------------------------------
+static int ownContents(Ref ref)
+{
+  PoolState* const pool = currentPool();
+  Node* target = findNode(ref);
+  int owned = (target != NULL && target->objReferenceCount != 0 && !target->isClone);
+
+  if(target != NULL && target->objReferenceCount != 0 && target->isClone)
+  {
+    Node* storage = target->storage;
+    // counts only say who else uses the storage when reference counting
+    if(storage->objReferenceCount == 1 && collectionMode == COLLECT_REFERENCE_COUNTING)
+    {
+      target->memStartIndex = storage->memStartIndex;
+      target->isClone = 0;
+      target->storage = NULL;
+      removeNode(storage);
+      invalidateTranslationCache();
+      owned = 1;
+    }
+    else
+    {
+      // the emergency reserve is kept back from copies too
+      ulong limit = MEMORY_SIZE - emergencyReserve;
+      if(!roomFor(target->memSize, limit, 0))
+      {
+        //fire garbage collection
+        compact();
+        // in tracing mode the object is gone if it wasn't reachable
+        target = findNode(ref);
+        // last resort, the emergency reserve
+        if(target != NULL && target->objReferenceCount != 0 && !roomFor(target->memSize, limit, 0)
+           && roomFor(target->memSize, MEMORY_SIZE, 0))
+        {
+          TRACEPOINT(EVENT_LOW_MEMORY, low_memory, target->memSize, (ulong)pool->nextAvailableIndex);
+          limit = MEMORY_SIZE;
+        }
+      }
+      if(target != NULL && target->objReferenceCount != 0 && roomFor(target->memSize, limit, 0))
+      {
+        memcpy(&(pool->activeBuffer[pool->nextAvailableIndex]), objectData(target), target->memSize);
+        releaseStorage(target);
+        target->memStartIndex = pool->nextAvailableIndex;
+        pool->nextAvailableIndex = pool->nextAvailableIndex + target->memSize;
+        raiseHighWater();
+        pool->bytesSinceCollection = pool->bytesSinceCollection + target->memSize;
+        // the copied ref fields are references of the clone's own
+        for(ulong slot = 0; slot < target->refSlotCount && collectionMode == COLLECT_REFERENCE_COUNTING; slot++)
+        {
+          Ref child = readRefSlot(target, slot);
+          // the storage still holds the child, so the count can't reach
+          // 0 before its shard gets this
+          if(inOtherShard(child))
+          {
+            queueShardChange(child, 1);
+          }
+          Node* childObj = (child != NULL_REF && !inOtherShard(child)) ? findNode(child) : NULL;
+          if(childObj != NULL && childObj->objReferenceCount != 0)
+          {
+            childObj->objReferenceCount++;
+          }
+        }
+        owned = 1;
+      }
+    }
+  }
+  return owned;
+} // end of ownContents()
+
+//------------------------------------------------------
+// releaseStorage
+//
+// PURPOSE: lets go of the reference a clone holds on its
+//          storage node, turning it into an ordinary object.
+//          Its contents must have been put somewhere else.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the clone
+//------------------------------------------------------
+static void releaseStorage(Node* aNode)
+{
+  PoolState* const pool = currentPool();
+  assert(aNode->isClone && aNode->storage != NULL);
+  Node* storage = aNode->storage;
+  if(collectionMode == COLLECT_REFERENCE_COUNTING && storage->objReferenceCount != 0)
+  {
+    storage->objReferenceCount--;
+    if(storage->objReferenceCount == 0)
+    {
+      pool->deadBytes = pool->deadBytes + storage->memSize;
+    }
+  }
+  aNode->isClone = 0;
+  aNode->storage = NULL;
+} // end of releaseStorage()
+
+//------------------------------------------------------
+// compact
+//
+// PURPOSE: this function initiates garbage collection.
+//          Reference Counting technique is used as a way
+//          of determining which objects are garbage.
+//          Defragmentation is handled by double buffering.
+//          To keep code clean, this function calls various
+//          other private functions to carry out the
+//          individual tasks.
+//------------------------------------------------------
+static void compact()
+{
+  PoolState* const pool = currentPool();
+  checkIndex(pool->indexing);
+  ulong startNs = currentTimeNs();
+  // pending reference count changes decide what is garbage (a sharded
+  // pool never logs any, but other shards may have sent some)
+  if(refLogLength > 0)
+  {
+    applyReferenceLog();
+  }
+  applyShardInbox();
+  if(gcLogging)
+  {
+    printf("\nGarbage collector statistics:\n");
+  }
+  TRACEPOINT(EVENT_GC_START, gc_start, pool->numCollections + 1, (ulong)pool->nextAvailableIndex);
+
+  //step1: move nongarbage together, copying it to the inactive
+  //buffer if it can't be slid down within the active buffer
+  //(objects held only by garbage are released along the way)
+  int copied = copyActToNonact();
+
+  //step2: swap buffers if the inactive buffer now holds the objects
+  if(copied)
+  {
+    if((ulong)pool->nextAvailableIndex > pool->inactiveHighWater)
+    {
+      pool->inactiveHighWater = (ulong)pool->nextAvailableIndex;
+    }
+    swapBuffers();
+  }
+
+  //step3: update index keeping track of objects
+  updateIndex();
+  invalidateTranslationCache();
+  checkIndex(pool->indexing);
+
+  //step4: give memory we no longer need back to the system
+  if(pageReleaseEnabled)
+  {
+    releaseUnusedPages();
+  }
+
+  // all the garbage is gone, start counting again
+  pool->deadBytes = 0;
+  pool->bytesSinceCollection = 0;
+  pool->lastCollectionTime = currentTimeNs();
+  pool->lastPauseNs = pool->lastCollectionTime - startNs;
+  pool->numCollections++;
+  TRACEPOINT(EVENT_GC_END, gc_end, pool->lastPauseNs, (ulong)pool->nextAvailableIndex);
+
+}// end of compact()
+
+//------------------------------------------------------
+// updateIndex
+//
+// PURPOSE: when garbage collection is initiated, this function
+//          helps update the index linked list to clean up
+//          and remove objects with a ref count of 0 after
+//          the buffers have been dealt with already. The
+//          index is walked once, unlinking and destroying
+//          each garbage node as we come across it.
+//
+//------------------------------------------------------
+static void updateIndex()
+{
+  PoolState* const pool = currentPool();
+  checkIndex(pool->indexing);
+
+  Node* curr = pool->indexing->top;
+  Node* prev = NULL;
+  while(curr != NULL)
+  {
+    Node* next = curr->next;
+    if(curr->objReferenceCount == 0)
+    {
+      if(prev == NULL) //removing from front
+      {
+        pool->indexing->top = next;
+      }
+      else //removing from back or middle
+      {
+        prev->next = next;
+      }
+      destroyNode(curr);
+    }
+    else
+    {
+      prev = curr;
+    }
+    curr = next;
+  }
+  pool->indexing->last = prev;
+  checkIndex(pool->indexing);
+}// end of updateIndex()
 
 //------------------------------------------------------
 // copyActToNonact
 //
-// PURPOSE: when garbage collection is initiated, this function
-//          helps with copying non garbage objects from the current
-//          active buffer to the inactive buffer. During this
-//          process we keep track of the garbage collection
-//          statistics and print them to the console. We make
-//          use of the index linked list ot see which objects
-//          are garbage and which aren't.
+// PURPOSE: when garbage collection is initiated, this function
+//          moves the non garbage objects together so the free
+//          memory is all at the end of the buffer. During this
+//          process we keep track of the garbage collection
+//          statistics and print them to the console. We make
+//          use of the index linked list ot see which objects
+//          are garbage and which aren't.
+//          Objects before the first garbage object (the dense
+//          prefix) are already where they belong and are left
+//          alone. If the objects after it are in the buffer in
+//          the same order as in the index, they are slid down
+//          within the active buffer, so the cost depends on
+//          the fragmented part of the buffer only. Otherwise
+//          every object is copied to the inactive buffer.
+//          When hot object reordering is on and objects have
+//          been sampled, they are all copied to the inactive
+//          buffer with the most used objects first.
+//
+// RETURN:
+// 1 if the objects were copied to the inactive buffer, which
+// then has to become the active buffer, 0 otherwise
+//------------------------------------------------------
+static int copyActToNonact()
+{
+  PoolState* const pool = currentPool();
+  checkIndex(pool->indexing);
+  // work out what is garbage first; garbage objects let go of what their
+  // ref fields point at, so whole object graphs are collected in this pass
+  if(collectionMode == COLLECT_TRACING)
+  {
+    // objects not reachable from the roots are garbage
+    traceFromRoots();
+  }
+  else
+  {
+    releaseDeadChildren();
+    // if that frees too little, unreachable cycles may be what's filling
+    // the pool; anything they held is released the same way
+    if(garbageBytes() < (ulong)(MEMORY_SIZE / 100) * cycleCollectionPercent)
+    {
+      if(collectCycles() > 0)
+      {
+        releaseDeadChildren();
+      }
+    }
+  }
+
+  int numObjects = 0;  // non garbage objects detected
+  int numHot = 0; // non garbage objects sampled since the last collection
+  ulong numBytes = 0;  // bytes in use
+  ulong numBytesCollected = 0; // bytes collected by GC
+
+  // gather the statistics (clones take up no memory of their own)
+  Node* curr = pool->indexing->top;
+  while(curr != NULL)
+  {
+    if(curr->objReferenceCount != 0)
+    {
+      numObjects = numObjects + (curr->hidden ? 0 : 1);
+      numBytes = numBytes + (curr->isClone ? 0 : curr->memSize);
+      if(curr->accessCount != 0)
+      {
+        numHot++;
+      }
+    }
+    else
+    {
+      numBytesCollected = numBytesCollected + (curr->isClone ? 0 : curr->memSize);
+    }
+    curr = curr->next;
+  }
+
+  int inPlace = 0;
+  if(accessSamplePeriod != 0 && numHot > 0)
+  {
+    // lay the most used objects out next to each other
+    copyHotFirst();
+  }
+  else
+  {
+    // find the dense prefix
+    int prefixEnd = 0; // where the dense prefix ends in the buffer
+    curr = pool->indexing->top;
+    while(curr != NULL && (curr->isClone || (curr->objReferenceCount != 0 && curr->memStartIndex == prefixEnd)))
+    {
+      prefixEnd = prefixEnd + (curr->isClone ? 0 : curr->memSize);
+      curr = curr->next;
+    }
+    Node* suffix = curr;
+
+    // sliding an object down can only overwrite memory that has already
+    // been dealt with if the objects are in index order in the buffer
+    inPlace = 1;
+    int lastEnd = prefixEnd;
+    while(curr != NULL && inPlace)
+    {
+      if(curr->objReferenceCount != 0 && !curr->isClone)
+      {
+        inPlace = (curr->memStartIndex >= lastEnd);
+        lastEnd = curr->memStartIndex + curr->memSize;
+      }
+      curr = curr->next;
+    }
+
+    uchar* targetBuffer = inPlace ? pool->activeBuffer : pool->inactiveBuffer;
+    int sizeTracker = inPlace ? prefixEnd : 0; // where next avail index is in the target buffer
+    curr = inPlace ? suffix : pool->indexing->top;
+    while(curr != NULL)
+    {
+      // we move non garbage only, clones have nothing to move
+      if(curr->objReferenceCount != 0 && !curr->isClone)
+      {
+        // the regions may overlap when sliding within the active buffer
+        memmove(&(targetBuffer[sizeTracker]), &(pool->activeBuffer[curr->memStartIndex]), curr->memSize);
+        // update the object's new offset
+        curr->memStartIndex = sizeTracker;
+        sizeTracker = sizeTracker + curr->memSize;
+      }
+      curr = curr->next;
+    }
+
+    // update global variable for object manager
+    pool->nextAvailableIndex = sizeTracker;
+  }
+
+  // printing garbage collection statistics
+  if(gcLogging)
+  {
+    printf("Objects: %d   Bytes in Use: %lu   Freed: %lu\n", numObjects, numBytes, numBytesCollected);
+  }
+  checkIndex(pool->indexing);
+  return !inPlace;
+}// end of copyActToNonact()
+
+//------------------------------------------------------
+// copyHotFirst
+//
+// PURPOSE: when garbage collection is initiated with hot object
+//          reordering on, this function copies the non garbage
+//          objects to the inactive buffer with the objects used
+//          the most first, so that objects used together in hot
+//          loops end up close together in memory. Objects that
+//          weren't sampled follow in index order. Access counts
+//          are halved afterwards, so the layout follows changes
+//          in what is hot.
+//------------------------------------------------------
+static void copyHotFirst()
+{
+  PoolState* const pool = currentPool();
+  int length = 0;
+  Node** table = makeNodeTable(&length);
+  qsort(table, length, sizeof(Node*), compareHotness);
+
+  int sizeTracker = 0; // size tracker for inactive buffer and where next avail index is
+  for(int i = 0; i < length; i++)
+  {
+    if(table[i]->objReferenceCount != 0 && !table[i]->isClone)
+    {
+      memcpy(&(pool->inactiveBuffer[sizeTracker]), &(pool->activeBuffer[table[i]->memStartIndex]), table[i]->memSize);
+      table[i]->memStartIndex = sizeTracker;
+      sizeTracker = sizeTracker + table[i]->memSize;
+    }
+    table[i]->accessCount = table[i]->accessCount / 2;
+  }
+  pool->nextAvailableIndex = sizeTracker;
+  free(table);
+} // end of copyHotFirst()
+
+//------------------------------------------------------
+// compareHotness
+//
+// PURPOSE: qsort comparison function ordering nodes by how
+//          often they were sampled, most used first, then by
+//          reference id (i.e. index order).
+//
+// RETURN:
+// negative, zero or positive as a orders before, with or
+// after b
+//------------------------------------------------------
+static int compareHotness(const void* a, const void* b)
+{
+  const Node* first = *(const Node* const*)a;
+  const Node* second = *(const Node* const*)b;
+  int result = 0;
+
+  if(first->accessCount != second->accessCount)
+  {
+    result = (first->accessCount > second->accessCount) ? -1 : 1;
+  }
+  else if(first->objReferenceID != second->objReferenceID)
+  {
+    result = (first->objReferenceID < second->objReferenceID) ? -1 : 1;
+  }
+  return result;
+} // end of compareHotness()
+
+//------------------------------------------------------
+// swapBuffers
+//
+// PURPOSE: when garbage collection is initiated, this function
+//          helps with swapping the active and inactive buffers
+//          after we have already copied non garbage from current
+//          active buffer to the inactive buffer.
+//------------------------------------------------------
+static void swapBuffers()
+{
+  PoolState* const pool = currentPool();
+  assert(pool->activeBuffer != NULL);
+  assert(pool->inactiveBuffer != NULL);
+
+  //swapping
+  uchar* temp = pool->activeBuffer;
+  pool->activeBuffer = pool->inactiveBuffer;
+  pool->inactiveBuffer = temp;
+  ulong tempHighWater = pool->activeHighWater;
+  pool->activeHighWater = pool->inactiveHighWater;
+  pool->inactiveHighWater = tempHighWater;
+  TRACEPOINT(EVENT_BUFFER_SWAP, buffer_swap, (ulong)pool->nextAvailableIndex, 0UL);
+  assert(pool->activeBuffer != NULL);
+  assert(pool->inactiveBuffer != NULL);
+}// swapBuffers()
+
+//------------------------------------------------------
+// releaseUnusedPages
+//
+// PURPOSE: after garbage collection, tells the system it
+//          can take back the pages of the inactive buffer and
+//          those past the used part of the active buffer, so
+//          the memory in use follows the live objects rather
+//          than the busiest the pool has ever been. The pages
+//          come back, zeroed, when they are next written.
+//          Hysteresis: pageReleaseSlack bytes past the used
+//          part stay in memory for the next allocations, and
+//          the rest of the tail is only given back once it is
+//          at least that big, so a pool whose size goes up
+//          and down a little doesn't keep faulting pages in.
+//------------------------------------------------------
+static void releaseUnusedPages()
+{
+  PoolState* const pool = currentPool();
+  // a shared pool's pages belong to its segment, not this process
+  int advice = pool->shared ? MADV_REMOVE : MADV_DONTNEED;
+
+  // explicit huge pages can only be given back whole
+  ulong keepEnd = roundUp(pool->nextAvailableIndex + pageReleaseSlack, pool->bufferPageSize);
+  ulong usedEnd = roundUp(pool->activeHighWater, pool->bufferPageSize);
+  if(usedEnd > keepEnd && usedEnd - keepEnd >= pageReleaseSlack)
+  {
+    madvise(pool->activeBuffer + keepEnd, usedEnd - keepEnd, advice);
+    pool->activeHighWater = keepEnd;
+  }
+
+  if(pool->inactiveHighWater > 0)
+  {
+    madvise(pool->inactiveBuffer, roundUp(pool->inactiveHighWater, pool->bufferPageSize), advice);
+    pool->inactiveHighWater = 0;
+  }
+} // end of releaseUnusedPages()
+
+//------------------------------------------------------
+// setPageRelease
+//
+// PURPOSE: turns giving unused pages back to the system
+//          after garbage collection on or off.
+//
+// INPUT PARAMETERS:
+// enabled - 1 to give pages back, 0 to keep them
+// slackBytes - bytes past the used part of the active buffer
+//              that stay in memory (see releaseUnusedPages)
+//------------------------------------------------------
+void setPageRelease(int enabled, ulong slackBytes)
+{
+  pageReleaseEnabled = (enabled != 0);
+  pageReleaseSlack = slackBytes;
+} // end of setPageRelease()
+
+//------------------------------------------------------
+// getCommittedBytes
+//
+// PURPOSE: reports how much of the two buffers may be
+//          taking up memory, i.e. has been written since it
+//          was last given back to the system.
+//
+// RETURN:
+// the number of bytes, 0 if no object manager is initialised
+//------------------------------------------------------
+ulong getCommittedBytes()
+{
+  ulong committed = 0;
+
+  // every shard of a sharded pool has buffers of its own
+  for(int shard = 0; numObjMngrs != 0 && shard < ((numShards > 0) ? numShards : 1); shard++)
+  {
+    Shard* previous = enterShard((Ref)shard << SHARD_SHIFT);
+    PoolState* const pool = currentPool();
+    lockPool();
+    ulong activeBytes = pool->activeHighWater;
+    if((ulong)pool->nextAvailableIndex > activeBytes)
+    {
+      activeBytes = pool->nextAvailableIndex;
+    }
+    committed = committed + pageAlign(activeBytes) + pageAlign(pool->inactiveHighWater);
+    unlockPool();
+    leaveShard(previous);
+  }
+  return committed;
+} // end of getCommittedBytes()
+
+//------------------------------------------------------
+// dumpPool()
+//
+// PURPOSE: This function traverses the index and prints the
+//          info in each non-garbage entry corresponding to
+//          a block of allocated memory. A sharded pool is
+//          dumped one shard at a time.
+//------------------------------------------------------
+void dumpPool()
+{
+  assert(numObjMngrs != 0);
+  //keeps track of the ith non-garbage object we found
+  int counter = 1;
+
+  for(int shard = 0; numObjMngrs != 0 && shard < ((numShards > 0) ? numShards : 1); shard++)
+  {
+    Shard* previous = enterShard((Ref)shard << SHARD_SHIFT);
+    PoolState* const pool = currentPool();
+    lockPool();
+    checkIndex(pool->indexing);
+
+    Node* curr = pool->indexing->top;
+    while(curr != NULL)
+    {
+      // print info if object is still in scope (storage isn't an object)
+      if(curr->objReferenceCount != 0 && !curr->hidden)
+      {
+        printf("\nObject #%d Info:\n", counter);
+        counter++;
+        printf("Starting index - %ld\n", (long)(objectData(curr) - pool->activeBuffer));
+        printf("Starting Address - %p\n", objectData(curr));
+        printf("Reference ID - %lu\n", curr->objReferenceID);
+        printf("Size - %lu\n", curr->memSize);
+        printf("Reference Count - %d\n", curr->objReferenceCount);
+      }
+      curr = curr->next;
+    }
+    checkIndex(pool->indexing);
+    unlockPool();
+    leaveShard(previous);
+  }
+  if(numObjMngrs == 0)
+  {
+    printf("No object manager initialised. Nothing available in memory pool to dump!\n");
+  }
+} // end of dumpPool()
+
+//------------------------------------------------------
+// beginObjects
+//
+// PURPOSE: starts a walk over the live objects
+//
+// INPUT PARAMETERS:
+// iterator - the walk to start
+//------------------------------------------------------
+void beginObjects(ObjectIterator* iterator)
+{
+  assert(iterator != NULL);
+  if(iterator != NULL)
+  {
+    iterator->lastRef = NULL_REF;
+    iterator->lastNode = NULL;
+    iterator->lastEpoch = 0;
+  }
+} // end of beginObjects()
+
+//------------------------------------------------------
+// nextObject
+//
+// PURPOSE: moves a walk over the live objects on to the next
+//          one. The index is in reference order, so the walk
+//          carries on from the node it reported last, or, if
+//          nodes have been destroyed since, from the first one
+//          past the ref it reported last. A sharded pool is
+//          walked one shard after the other, which keeps the
+//          walk in reference order.
+//
+// INPUT PARAMETERS:
+// iterator - the walk, started by beginObjects
+// info - filled in with the next live object
+//
+// RETURN:
+// 1 if there was a next live object, 0 otherwise
+//------------------------------------------------------
+int nextObject(ObjectIterator* iterator, ObjectInfo* info)
+{
+  assert(numObjMngrs != 0);
+  assert(iterator != NULL && info != NULL);
+  int found = 0;
+
+  int shard = (iterator != NULL) ? SHARD_OF(iterator->lastRef) : 0;
+  int lastShard = (numShards > 0) ? numShards - 1 : 0;
+  while(numObjMngrs != 0 && iterator != NULL && info != NULL && !found && shard <= lastShard)
+  {
+    Shard* previous = enterShard((Ref)shard << SHARD_SHIFT);
+    PoolState* const pool = currentPool();
+    lockPool();
+    Node* curr = NULL;
+    // the walk starts on a shard it hasn't reported from yet
+    if(iterator->lastRef == NULL_REF || SHARD_OF(iterator->lastRef) != shard)
+    {
+      curr = nextLiveNode(pool->indexing->top);
+    }
+    else if(iterator->lastNode != NULL && iterator->lastEpoch == pool->indexEpoch)
+    {
+      curr = nextLiveNode(((Node*)iterator->lastNode)->next);
+    }
+    else
+    {
+      curr = pool->indexing->top;
+      while(curr != NULL && curr->objReferenceID <= iterator->lastRef)
+      {
+        curr = curr->next;
+      }
+      curr = nextLiveNode(curr);
+    }
+
+    if(curr != NULL)
+    {
+      info->ref = curr->objReferenceID;
+      info->offset = (ulong)(objectData(curr) - pool->activeBuffer);
+      info->size = curr->memSize;
+      info->referenceCount = curr->objReferenceCount;
+      iterator->lastRef = curr->objReferenceID;
+      iterator->lastNode = curr;
+      iterator->lastEpoch = pool->indexEpoch;
+      found = 1;
+    }
+    unlockPool();
+    leaveShard(previous);
+    shard++;
+  }
+  return found;
+} // end of nextObject()
+
+//------------------------------------------------------
+// nextLiveNode
+//
+// PURPOSE: skips the garbage and clone storage in the index
+//
+// INPUT PARAMETERS:
+// curr - the node to start from
+//
+// RETURN:
+// the first live object's node from curr on, NULL if none
+//------------------------------------------------------
+static Node* nextLiveNode(Node* curr)
+{
+  while(curr != NULL && (curr->objReferenceCount == 0 || curr->hidden))
+  {
+    curr = curr->next;
+  }
+  return curr;
+} // end of nextLiveNode()
+
+//------------------------------------------------------
+// dumpPoolTo
+//
+// PURPOSE: streams every live object to a file descriptor
+//          in a format meant for programs rather than
+//          people. The pool is held for the whole dump, so
+//          it is a consistent snapshot; a sharded pool has all
+//          its shards held, taken in shard order so two dumps
+//          can't each wait for the other.
+//
+// INPUT PARAMETERS:
+// fd - an open file descriptor to write to
+// format - DUMP_FORMAT_BINARY or DUMP_FORMAT_JSON
+//
+// RETURN:
+// 1 if the whole dump was written, 0 otherwise
+//------------------------------------------------------
+int dumpPoolTo(int fd, int format)
+{
+  assert(numObjMngrs != 0);
+  assert(format == DUMP_FORMAT_BINARY || format == DUMP_FORMAT_JSON);
+  int written = 0;
+
+  if(numObjMngrs != 0 && (format == DUMP_FORMAT_BINARY || format == DUMP_FORMAT_JSON))
+  {
+    // write through our own descriptor so closing the stream leaves fd open
+    int dumpFd = dup(fd);
+    FILE* out = (dumpFd >= 0) ? fdopen(dumpFd, "w") : NULL;
+    if(out != NULL)
+    {
+      setvbuf(out, NULL, _IOFBF, DUMP_BUFFER_SIZE);
+      int lastShard = (numShards > 0) ? numShards - 1 : 0;
+      for(int shard = 0; shard <= lastShard; shard++)
+      {
+        lockShardOf((Ref)shard << SHARD_SHIFT);
+      }
+      int ok = 1;
+      if(format == DUMP_FORMAT_BINARY)
+      {
+        ulong header[2] = { DUMP_BINARY_MAGIC, MEMORY_SIZE };
+        ok = (fwrite(header, sizeof(header), 1, out) == 1);
+      }
+
+      ObjectIterator iterator;
+      ObjectInfo info;
+      beginObjects(&iterator);
+      while(ok && nextObject(&iterator, &info))
+      {
+        if(format == DUMP_FORMAT_BINARY)
+        {
+          ulong record[4] = { info.ref, info.offset, info.size, info.referenceCount };
+          ok = (fwrite(record, sizeof(record), 1, out) == 1);
+        }
+        else
+        {
+          ok = (fprintf(out, "{\"ref\":%lu,\"offset\":%lu,\"size\":%lu,\"count\":%lu}\n",
+                        info.ref, info.offset, info.size, info.referenceCount) > 0);
+        }
+      }
+
+      if(ok && format == DUMP_FORMAT_BINARY)
+      {
+        ulong end[4] = { 0, 0, 0, 0 };
+        ok = (fwrite(end, sizeof(end), 1, out) == 1);
+      }
+      for(int shard = lastShard; shard >= 0; shard--)
+      {
+        unlockShardOf((Ref)shard << SHARD_SHIFT);
+      }
+      written = (fclose(out) == 0) && ok;
+    }
+    else if(dumpFd >= 0)
+    {
+      close(dumpFd);
+    }
+    if(!written)
+    {
+      printf("Unable to dump the memory pool to file descriptor %d\n", fd);
+    }
+  }
+  return written;
+} // end of dumpPoolTo()
+
+//------------------------------------------------------
+// retrieveObject
+//
+// PURPOSE: returns a pointer to the object in memory being
+//          requested given by the reference id
+//
+// INPUT PARAMETERS:
+// ref - the reference id for the object to which we want
+//       the pointer for
+//
+// RETURN:
+// a void pointer to where the x amount of memory was allocated
+// for the object.
+//------------------------------------------------------
+void* retrieveObject(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  void* ptr = NULL;
+
+  if(numObjMngrs != 0)
+  {
+    lockPool();
+    ptr = retrieveFromPool(ref);
+    unlockPool();
+  }
+  leaveShard(previous);
+  return ptr;
+} // end of retrieveObject
+
+//------------------------------------------------------
+// retrieveObjectUnlocked
+//
+// PURPOSE: retrieveObject for a caller that locks the pool
+//          itself, or whose pool is never locked (see
+//          ObjectPool.h). Sharded pools aren't supported.
+//
+// INPUT PARAMETERS:
+// ref - the reference id for the object to which we want
+//       the pointer for
+//
+// RETURN:
+// a pointer to the object, NULL if there is none or the
+// pool is sharded
+//------------------------------------------------------
+void* retrieveObjectUnlocked(Ref ref)
+{
+  assert(numObjMngrs != 0 && numShards == 0);
+  void* ptr = NULL;
+  if(numObjMngrs != 0 && numShards == 0)
+  {
+    ptr = retrieveFromPool(ref);
+  }
+  return ptr;
+} // end of retrieveObjectUnlocked()
+
+//------------------------------------------------------
+// retrieveFromPool
+//
+// PURPOSE: finds an object's contents in the pool (or shard)
+//          being worked on. The caller holds the pool.
+//
+// INPUT PARAMETERS:
+// ref - the reference id of the object
+//
+// RETURN:
+// a pointer to the object, NULL if it isn't in the pool
+//------------------------------------------------------
+static void* retrieveFromPool(Ref ref)
+{
+  void* ptr = NULL;
+  // reference being used hasn't been given out yet
+  assert(ref < currentPool()->referenceID);
+  assert(ref != NULL_REF);
+  // procced if ref is not null
+  if(ref != NULL_REF)
+  {
+    // find the node in the index with the ref of interest
+    Node* target = findNode(ref);
+    // if the node was found and it is not out of scope
+    if(target != NULL && target->objReferenceCount != 0)
+    {
+      checkNode(target);
+      // sample which objects are used the most
+      if(accessSamplePeriod != 0)
+      {
+        accessTicker++;
+        if(accessTicker >= accessSamplePeriod)
+        {
+          accessTicker = 0;
+          // what gets laid out is the block holding the contents
+          Node* block = target->isClone ? target->storage : target;
+          block->accessCount++;
+        }
+      }
+      ptr = objectData(target);
+      assert(ptr != NULL);
+    }
+  }
+  else
+  {
+    assert(ptr == NULL);
+  }
+  traceOperation(TRACE_RETRIEVE, ref, 0, 0);
+  return ptr;
+} // end of retrieveFromPool()
+
+//------------------------------------------------------
+// findNode
+//
+// PURPOSE: searches the index for a node with the specific
+//          ref id.
+//
+// INPUT PARAMETERS:
+// ref - the reference id we are searching for
+//
+// RETURN:
+// if found, a pointer to the target node, null otherwise
+//------------------------------------------------------
+static Node* findNode(Ref ref)
+{
+  PoolState* const pool = currentPool();
+  assert(ref < pool->referenceID);
+  assert(ref != NULL_REF);
+
+  Node* returnNode = NULL;
+  if(ref != NULL_REF)
+  {
+    checkIndex(pool->indexing);
+    // try the translation cache before walking the index
+    TranslationCache* cache = currentCache();
+    TranslationEntry* entry = &(cache->entries[ref & (TRANSLATION_CACHE_SIZE - 1)]);
+    if(entry->ref == ref && entry->epoch == pool->indexEpoch)
+    {
+      cache->hits++;
+      returnNode = entry->node;
+    }
+    else
+    {
+      cache->misses++;
+      Node* curr = pool->indexing->top;
+      // iterate until we reach the end or find the target ref
+      while(curr != NULL && curr->objReferenceID != ref)
+      {
+        curr = curr->next;
+      }
+      returnNode = curr;
+      if(returnNode != NULL)
+      {
+        entry->ref = ref;
+        entry->node = returnNode;
+        entry->epoch = pool->indexEpoch;
+      }
+    }
+    checkIndex(pool->indexing);
+  }
+  return returnNode;
+
+} // end of findNode()
+
+//------------------------------------------------------
+// invalidateTranslationCache
+//
+// PURPOSE: forgets every entry in the translation cache.
+//          Must be called whenever nodes are destroyed, so
+//          the cache never hands out a node that is gone.
+//          Entries are stamped with the epoch they were made
+//          in, so bumping the epoch invalidates them all at
+//          once without touching the cache.
+//------------------------------------------------------
+static void invalidateTranslationCache()
+{
+  PoolState* const pool = currentPool();
+  pool->indexEpoch++;
+} // end of invalidateTranslationCache()
+
+//------------------------------------------------------
+// getTranslationCacheStats
+//
+// PURPOSE: reports how well the translation cache is doing
+//
+// INPUT PARAMETERS:
+// hits - set to the lookups answered by the cache
+// misses - set to the lookups that had to walk the index
+//------------------------------------------------------
+void getTranslationCacheStats(ulong* hits, ulong* misses)
+{
+  ulong totalHits = (numShards == 0) ? privateCache.hits : 0;
+  ulong totalMisses = (numShards == 0) ? privateCache.misses : 0;
+
+  // each shard has a cache of its own
+  for(int shard = 0; shard < numShards; shard++)
+  {
+    Shard* previous = enterShard((Ref)shard << SHARD_SHIFT);
+    lockPool();
+    totalHits = totalHits + shards[shard].cache.hits;
+    totalMisses = totalMisses + shards[shard].cache.misses;
+    unlockPool();
+    leaveShard(previous);
+  }
+  if(hits != NULL)
+  {
+    *hits = totalHits;
+  }
+  if(misses != NULL)
+  {
+    *misses = totalMisses;
+  }
+} // end of getTranslationCacheStats()
+
+//------------------------------------------------------
+// makeNodeTable
+//
+// PURPOSE: builds an array of all the nodes in the index, in
+//          index order. Nodes are added to the index as their
+//          reference ids are handed out, so the array is
+//          sorted by reference id and can be binary searched
+//          when a lot of lookups have to be made at once.
+//
+// INPUT PARAMETERS:
+// length - set to the number of nodes in the array
+//
+// RETURN:
+// the array of nodes, to be freed by the caller
+//------------------------------------------------------
+static Node** makeNodeTable(int* length)
+{
+  PoolState* const pool = currentPool();
+  checkIndex(pool->indexing);
+  int numNodes = 0;
+  Node* curr = pool->indexing->top;
+  while(curr != NULL)
+  {
+    numNodes++;
+    curr = curr->next;
+  }
+
+  Node** table = (Node**)(malloc(sizeof(Node*) * (numNodes + 1)));
+  assert(table != NULL);
+  numNodes = 0;
+  curr = pool->indexing->top;
+  while(curr != NULL)
+  {
+    table[numNodes] = curr;
+    numNodes++;
+    curr = curr->next;
+  }
+  *length = numNodes;
+  return table;
+} // end of makeNodeTable()
+
+//------------------------------------------------------
+// searchNodeTable
+//
+// PURPOSE: binary searches a table made by makeNodeTable for
+//          the node with the given ref id.
+//
+// INPUT PARAMETERS:
+// table - nodes sorted by reference id
+// length - number of nodes in the table
+// ref - the reference id we are searching for
+//
+// RETURN:
+// if found, a pointer to the target node, null otherwise
+//------------------------------------------------------
+static Node* searchNodeTable(Node** table, int length, Ref ref)
+{
+  Node* returnNode = NULL;
+  int low = 0;
+  int high = length - 1;
+
+  while(low <= high && returnNode == NULL)
+  {
+    int middle = low + (high - low) / 2;
+    if(table[middle]->objReferenceID == ref)
+    {
+      returnNode = table[middle];
+    }
+    else if(table[middle]->objReferenceID < ref)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+  return returnNode;
+} // end of searchNodeTable()
+
+//------------------------------------------------------
+// addReference
+//
+// PURPOSE: updates our index to indicate that we have another
+//          reference to the given object
+//
+// INPUT PARAMETERS:
+// ref - reference to the object for which we want to increment
+//       number of references
+//------------------------------------------------------
+void addReference(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  PoolState* const pool = currentPool();
+
+  // in tracing mode reachability is worked out from the roots instead
+  if(numObjMngrs != 0 && collectionMode == COLLECT_REFERENCE_COUNTING)
+  {
+    lockPool();
+    // reference being used hasn't been given out yet
+    assert(ref < pool->referenceID);
+    assert(ref != NULL_REF);
+
+    // each process (or shard) would need its own log, so shared and
+    // sharded pools count immediately
+    if(ref != NULL_REF && deferredCounting && !pool->shared && numShards == 0)
+    {
+      logReferenceChange(ref, 1);
+    }
+    else if(ref != NULL_REF)
+    {
+      //find the node of interest
+      Node* targetObj = findNode(ref);
+      // if node is found and it is still in scope
+      if(targetObj != NULL && targetObj->objReferenceCount != 0)
+      {
+        checkNode(targetObj);
+        targetObj->objReferenceCount++;
+        checkNode(targetObj);
+      }
+    }
+    traceOperation(TRACE_ADD_REFERENCE, ref, 0, 0);
+    unlockPool();
+  }
+  leaveShard(previous);
+} //end of addReference
+
+//------------------------------------------------------
+// dropReference
+//
+// PURPOSE: updates our index to indicate that we have lost
+//          a reference to the given object
+//
+// INPUT PARAMETERS:
+// ref - reference to the object for which we want to decrement
+//       number of references
+//------------------------------------------------------
+void dropReference(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  PoolState* const pool = currentPool();
+
+  // in tracing mode reachability is worked out from the roots instead
+  if(numObjMngrs != 0 && collectionMode == COLLECT_REFERENCE_COUNTING)
+  {
+    lockPool();
+    // reference being used hasn't been given out yet
+    assert(ref < pool->referenceID);
+    assert(ref != NULL_REF);
+
+    // each process (or shard) would need its own log, so shared and
+    // sharded pools count immediately
+    if(ref != NULL_REF && deferredCounting && !pool->shared && numShards == 0)
+    {
+      logReferenceChange(ref, -1);
+      pool->reserveBackoff = 0;
+    }
+    else if(ref != NULL_REF)
+    {
+      // find the node of interest
+      Node* targetObj = findNode(ref);
+      // if node is found and it is still in scope
+      if(targetObj != NULL && targetObj->objReferenceCount != 0)
+      {
+        checkNode(targetObj);
+        pool->reserveBackoff = 0;
+        targetObj->objReferenceCount--;
+        if(targetObj->objReferenceCount == 0)
+        {
+          pool->deadBytes = pool->deadBytes + targetObj->memSize;
+        }
+        checkNode(targetObj);
+      }
+    }
+    traceOperation(TRACE_DROP_REFERENCE, ref, 0, 0);
+    unlockPool();
+  }
+  leaveShard(previous);
+} // end of dropReference()
+
+//------------------------------------------------------
+// setRefField
+//
+// PURPOSE: stores a reference in one of an object's ref
+//          fields. The field holds a reference of its own on
+//          the object it points at, and lets go of whatever
+//          it pointed at before. In a sharded pool the
+//          objects may be in different shards, so the new
+//          reference is taken before the object's shard is
+//          locked and the old one dropped after it is let go
+//          of, and no two shards are ever locked at once.
+//
+// INPUT PARAMETERS:
+// ref - the object whose ref field is being set
+// slot - which ref field to set
+// value - the reference to store, NULL_REF to clear the field
+//
+// RETURN:
+// 1 if the field was set, 0 if the object isn't alive, has no
+// such field, or is a clone and there is no room to give it
+// contents of its own
+//------------------------------------------------------
+int setRefField(Ref ref, ulong slot, Ref value)
+{
+  assert(numObjMngrs != 0);
+  int written = 0;
+
+  if(numObjMngrs != 0 && ref != NULL_REF)
+  {
+    Ref oldValue = NULL_REF;
+    traceOperation(TRACE_SET_REF_FIELD, ref, slot, value);
+    traceSuspended++;
+    if(value != NULL_REF)
+    {
+      addReference(value);
+    }
+
+    Shard* previous = enterShard(ref);
+    lockPool();
+    // writing a clone's ref field gives it contents of its own first
+    Node* targetObj = ownContents(ref) ? findNode(ref) : NULL;
+    if(targetObj != NULL && targetObj->objReferenceCount != 0 && slot < targetObj->refSlotCount)
+    {
+      oldValue = readRefSlot(targetObj, slot);
+      writeRefSlot(targetObj, slot, value);
+      written = 1;
+    }
+    unlockPool();
+    leaveShard(previous);
+
+    // the field didn't take the new reference after all
+    if(!written && value != NULL_REF)
+    {
+      dropReference(value);
+    }
+    if(oldValue != NULL_REF)
+    {
+      dropReference(oldValue);
+    }
+    traceSuspended--;
+  }
+  return written;
+} // end of setRefField()
+
+//------------------------------------------------------
+// getRefField
+//
+// PURPOSE: reads one of an object's ref fields
+//
+// INPUT PARAMETERS:
+// ref - the object whose ref field is being read
+// slot - which ref field to read
+//
+// RETURN:
+// the reference stored in the field, or NULL_REF if the field
+// is empty or doesn't exist
+//------------------------------------------------------
+Ref getRefField(Ref ref, ulong slot)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  Ref value = NULL_REF;
+
+  if(numObjMngrs != 0 && ref != NULL_REF)
+  {
+    lockPool();
+    Node* targetObj = findNode(ref);
+    if(targetObj != NULL && targetObj->objReferenceCount != 0 && slot < targetObj->refSlotCount)
+    {
+      value = readRefSlot(targetObj, slot);
+    }
+    unlockPool();
+  }
+  leaveShard(previous);
+  return value;
+} // end of getRefField()
+
+//------------------------------------------------------
+// readRefSlot
+//
+// PURPOSE: reads a ref field straight out of the active
+//          buffer. Objects aren't aligned in the buffer so
+//          the field is copied out rather than dereferenced.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object being read
+// slot - which ref field to read
+//
+// RETURN:
+// the reference stored in the field
+//------------------------------------------------------
+static Ref readRefSlot(Node* aNode, ulong slot)
+{
+  assert(slot < aNode->refSlotCount);
+  Ref value;
+  memcpy(&value, objectData(aNode) + slot * sizeof(Ref), sizeof(Ref));
+  return value;
+} // end of readRefSlot()
+
+//------------------------------------------------------
+// writeRefSlot
+//
+// PURPOSE: writes a ref field straight into the active
+//          buffer, without touching any reference counts.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object being written
+// slot - which ref field to write
+// value - the reference to store
+//------------------------------------------------------
+static void writeRefSlot(Node* aNode, ulong slot, Ref value)
+{
+  assert(slot < aNode->refSlotCount);
+  assert(!aNode->isClone);
+  memcpy(objectData(aNode) + slot * sizeof(Ref), &value, sizeof(Ref));
+} // end of writeRefSlot()
+
+//------------------------------------------------------
+// objectData
+//
+// PURPOSE: finds an object's contents in the active buffer.
+//          A clone's contents are kept by its storage node.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object
+//
+// RETURN:
+// a pointer to the contents, NULL for a clone that has let
+// go of its storage
+//------------------------------------------------------
+static uchar* objectData(Node* aNode)
+{
+  PoolState* const pool = currentPool();
+  uchar* data = NULL;
+  if(!aNode->isClone)
+  {
+    data = &(pool->activeBuffer[aNode->memStartIndex]);
+  }
+  else if(aNode->storage != NULL)
+  {
+    data = &(pool->activeBuffer[aNode->storage->memStartIndex]);
+  }
+  return data;
+} // end of objectData()
+
+//------------------------------------------------------
+// numChildren
+//
+// PURPOSE: counts the references an object holds on other
+//          objects, which the garbage collector follows. An
+//          object holds one per ref field; a clone doesn't
+//          own the ref fields it shares, it holds one on its
+//          storage node instead.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object
+//
+// RETURN:
+// the number of references the object holds
+//------------------------------------------------------
+static ulong numChildren(Node* aNode)
+{
+  ulong count = aNode->refSlotCount;
+  if(aNode->isClone)
+  {
+    count = (aNode->storage != NULL) ? 1 : 0;
+  }
+  return count;
+} // end of numChildren()
+
+//------------------------------------------------------
+// readChild
+//
+// PURPOSE: reads one of the references an object holds (see
+//          numChildren)
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object
+// child - which of its references to read
+//
+// RETURN:
+// the reference, NULL_REF if it is empty
+//------------------------------------------------------
+static Ref readChild(Node* aNode, ulong child)
+{
+  assert(child < numChildren(aNode));
+  Ref value = NULL_REF;
+  if(aNode->isClone)
+  {
+    value = aNode->storage->objReferenceID;
+  }
+  else
+  {
+    value = readRefSlot(aNode, child);
+  }
+  return value;
+} // end of readChild()
+
+//------------------------------------------------------
+// clearChild
+//
+// PURPOSE: empties one of the references an object holds
+//          (see numChildren), without touching any counts.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object
+// child - which of its references to clear
+//------------------------------------------------------
+static void clearChild(Node* aNode, ulong child)
+{
+  assert(child < numChildren(aNode));
+  if(aNode->isClone)
+  {
+    aNode->storage = NULL;
+  }
+  else
+  {
+    writeRefSlot(aNode, child, NULL_REF);
+  }
+} // end of clearChild()
+
+//------------------------------------------------------
+// releaseRefFields
+//
+// PURPOSE: drops the references held by an object's ref
+//          fields and clears the fields, for an object that
+//          is about to disappear from the index.
+//
+// INPUT PARAMETERS:
+// aNode - the node of the object letting go of its fields
+//------------------------------------------------------
+static void releaseRefFields(Node* aNode)
+{
+  PoolState* const pool = currentPool();
+  ulong count = numChildren(aNode);
+  for(ulong slot = 0; slot < count; slot++)
+  {
+    Ref child = readChild(aNode, slot);
+    // a child in another shard lets go when that shard next collects
+    if(inOtherShard(child))
+    {
+      queueShardChange(child, -1);
+    }
+    // counts only mean something when reference counting
+    else if(child != NULL_REF && child < pool->referenceID && collectionMode == COLLECT_REFERENCE_COUNTING)
+    {
+      Node* childObj = findNode(child);
+      if(childObj != NULL && childObj->objReferenceCount != 0)
+      {
+        childObj->objReferenceCount--;
+        if(childObj->objReferenceCount == 0)
+        {
+          pool->deadBytes = pool->deadBytes + childObj->memSize;
+        }
+      }
+    }
+    clearChild(aNode, slot);
+  }
+} // end of releaseRefFields()
+
+//------------------------------------------------------
+// releaseDeadChildren
+//
+// PURPOSE: when garbage collection is initiated, this function
+//          makes every garbage object let go of the objects its
+//          ref fields point at. An object that loses its last
+//          reference this way is garbage too and lets go of
+//          its own fields in turn, so a whole graph hanging off
+//          a garbage object is released in one go. A worklist
+//          is used instead of recursion so deep graphs can't
+//          overflow the stack.
+//------------------------------------------------------
+static void releaseDeadChildren()
+{
+  int length = 0;
+  Node** table = makeNodeTable(&length);
+  Node** worklist = (Node**)(malloc(sizeof(Node*) * (length + 1)));
+  assert(worklist != NULL);
+  int pending = 0;
+
+  // every garbage object with ref fields (or storage) starts on the worklist
+  for(int i = 0; i < length; i++)
+  {
+    if(table[i]->objReferenceCount == 0 && numChildren(table[i]) > 0)
+    {
+      worklist[pending] = table[i];
+      pending++;
+    }
+  }
+
+  while(pending > 0)
+  {
+    pending--;
+    Node* curr = worklist[pending];
+    ulong count = numChildren(curr);
+    for(ulong slot = 0; slot < count; slot++)
+    {
+      Ref childRef = readChild(curr, slot);
+      Node* child = searchNodeTable(table, length, childRef);
+      if(inOtherShard(childRef))
+      {
+        queueShardChange(childRef, -1);
+      }
+      else if(child != NULL && child->objReferenceCount != 0)
+      {
+        child->objReferenceCount--;
+        // an object is only ever added once, when it reaches 0
+        if(child->objReferenceCount == 0 && numChildren(child) > 0)
+        {
+          worklist[pending] = child;
+          pending++;
+        }
+      }
+      clearChild(curr, slot);
+    }
+  }
+
+  free(worklist);
+  free(table);
+} // end of releaseDeadChildren()
+
+//------------------------------------------------------
+// setCycleCollectionThreshold
+//
+// PURPOSE: sets how little a garbage collection has to free
+//          before the cycle collector runs as part of it.
+//
+// INPUT PARAMETERS:
+// percent - cycles are looked for when a collection would free
+//           less than this percentage of the memory. 0 turns the
+//           cycle collector off.
+//------------------------------------------------------
+void setCycleCollectionThreshold(int percent)
+{
+  assert(percent >= 0 && percent <= 100);
+  if(percent >= 0 && percent <= 100)
+  {
+    cycleCollectionPercent = percent;
+  }
+} // end of setCycleCollectionThreshold()
+
+//------------------------------------------------------
+// garbageBytes
+//
+// PURPOSE: adds up the memory held by garbage objects, i.e.
+//          what a garbage collection would free right now.
+//
+// RETURN:
+// the number of bytes held by objects with a ref count of 0
+//------------------------------------------------------
+static ulong garbageBytes()
+{
+  PoolState* const pool = currentPool();
+  ulong numBytes = 0;
+  Node* curr = pool->indexing->top;
+  while(curr != NULL)
+  {
+    if(curr->objReferenceCount == 0 && !curr->isClone)
+    {
+      numBytes = numBytes + curr->memSize;
+    }
+    curr = curr->next;
+  }
+  return numBytes;
+} // end of garbageBytes()
+
+//------------------------------------------------------
+// collectCycles
+//
+// PURPOSE: finds objects that are only kept alive by
+//          references from other objects in a cycle, and
+//          turns them into garbage. Reference counting on its
+//          own never collects these. For every object we
+//          subtract the references coming from ref fields of
+//          other live objects from its count; whatever is left
+//          over must come from outside the pool. Objects with
+//          references from outside, and everything reachable
+//          from them through ref fields, are alive. Every other
+//          live object can only be reached from garbage.
+//
+// RETURN:
+// the number of objects found to be garbage
+//------------------------------------------------------
+static int collectCycles()
+{
+  int length = 0;
+  Node** table = makeNodeTable(&length);
+  Node** worklist = (Node**)(malloc(sizeof(Node*) * (length + 1)));
+  assert(worklist != NULL);
+  int pending = 0;
+  int numCollected = 0;
+
+  for(int i = 0; i < length; i++)
+  {
+    table[i]->externalCount = table[i]->objReferenceCount;
+    table[i]->marked = 0;
+  }
+
+  // take away the references live objects hold on each other
+  for(int i = 0; i < length; i++)
+  {
+    if(table[i]->objReferenceCount != 0)
+    {
+      for(ulong slot = 0; slot < numChildren(table[i]); slot++)
+      {
+        Node* child = searchNodeTable(table, length, readChild(table[i], slot));
+        if(child != NULL && child->objReferenceCount != 0)
+        {
+          child->externalCount--;
+        }
+      }
+    }
+  }
+
+  // objects still referenced from outside are where marking starts
+  for(int i = 0; i < length; i++)
+  {
+    if(table[i]->externalCount > 0)
+    {
+      table[i]->marked = 1;
+      worklist[pending] = table[i];
+      pending++;
+    }
+  }
+  markFrom(table, length, worklist, pending);
+
+  // live but unreachable from outside: garbage
+  for(int i = 0; i < length; i++)
+  {
+    if(table[i]->objReferenceCount != 0 && !table[i]->marked)
+    {
+      table[i]->objReferenceCount = 0;
+      numCollected++;
+    }
+  }
+
+  free(worklist);
+  free(table);
+  return numCollected;
+} // end of collectCycles()
+
+//------------------------------------------------------
+// markFrom
+//
+// PURPOSE: marks every live object reachable through ref
+//          fields from the objects on the worklist. Objects
+//          on the worklist must be marked already.
+//
+// INPUT PARAMETERS:
+// table - nodes sorted by reference id
+// length - number of nodes in the table
+// worklist - room for length nodes, holding the starting nodes
+// pending - number of starting nodes on the worklist
+//------------------------------------------------------
+static void markFrom(Node** table, int length, Node** worklist, int pending)
+{
+  while(pending > 0)
+  {
+    pending--;
+    Node* curr = worklist[pending];
+    for(ulong slot = 0; slot < numChildren(curr); slot++)
+    {
+      Node* child = searchNodeTable(table, length, readChild(curr, slot));
+      // each object is marked, and so added, at most once
+      if(child != NULL && child->objReferenceCount != 0 && !child->marked)
+      {
+        child->marked = 1;
+        worklist[pending] = child;
+        pending++;
+      }
+    }
+  }
+} // end of markFrom()
+
+//------------------------------------------------------
+// setCollectionMode
+//
+// PURPOSE: chooses how the garbage collector decides what is
+//          garbage. It can only be changed while no object
+//          manager is initialised.
+//
+// INPUT PARAMETERS:
+// mode - COLLECT_REFERENCE_COUNTING or COLLECT_TRACING
+//------------------------------------------------------
+void setCollectionMode(int mode)
+{
+  assert(numObjMngrs == 0);
+  assert(mode == COLLECT_REFERENCE_COUNTING || mode == COLLECT_TRACING);
+
+  if(numObjMngrs == 0 && (mode == COLLECT_REFERENCE_COUNTING || mode == COLLECT_TRACING))
+  {
+    collectionMode = mode;
+  }
+  else
+  {
+    printf("The collection mode can only be changed while no object manager is initialised.\n");
+  }
+} // end of setCollectionMode()
+
+//------------------------------------------------------
+// setThreadSafe
+//
+// PURPOSE: chooses whether a private pool can be used from
+//          several threads at once. If so, every call holds
+//          the pool's lock, as for shared pools. It can only
+//          be changed while no object manager is initialised.
+//
+// INPUT PARAMETERS:
+// enabled - 1 to lock the pool, 0 not to (the default)
+//------------------------------------------------------
+void setThreadSafe(int enabled)
+{
+  assert(numObjMngrs == 0);
+
+  if(numObjMngrs == 0)
+  {
+    if(enabled && !privateLockReady)
+    {
+      // recursive, since public functions call each other
+      pthread_mutexattr_t attributes;
+      pthread_mutexattr_init(&attributes);
+      pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+      pthread_mutex_init(&(privatePool.lock), &attributes);
+      pthread_mutexattr_destroy(&attributes);
+      privateLockReady = 1;
+    }
+    threadSafe = (enabled != 0);
+  }
+  else
+  {
+    printf("Thread safety can only be changed while no object manager is initialised.\n");
+  }
+} // end of setThreadSafe()
+
+//------------------------------------------------------
+// addRoot
+//
+// PURPOSE: registers a reference as a root for tracing. The
+//          object stays alive for as long as it is a root.
+//
+// INPUT PARAMETERS:
+// ref - the reference to register
+//------------------------------------------------------
+void addRoot(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  if(numObjMngrs != 0 && ref != NULL_REF)
+  {
+    lockPool();
+    if(numRoots == rootsCapacity)
+    {
+      roots = (Ref*)(growArray(roots, &rootsCapacity, sizeof(Ref)));
+    }
+    roots[numRoots] = ref;
+    numRoots++;
+    unlockPool();
+  }
+} // end of addRoot()
+
+//------------------------------------------------------
+// removeRoot
+//
+// PURPOSE: unregisters one registration of a root reference
+//
+// INPUT PARAMETERS:
+// ref - the reference to unregister
+//------------------------------------------------------
+void removeRoot(Ref ref)
+{
+  int found = 0;
+  lockPool();
+  for(int i = 0; i < numRoots && !found; i++)
+  {
+    if(roots[i] == ref)
+    {
+      // order doesn't matter, fill the hole with the last root
+      roots[i] = roots[numRoots - 1];
+      numRoots--;
+      found = 1;
+    }
+  }
+  unlockPool();
+} // end of removeRoot()
+
+//------------------------------------------------------
+// addRootSlot
+//
+// PURPOSE: registers a variable holding a reference as a root
+//          for tracing. Whatever the variable holds when the
+//          garbage collector runs stays alive.
+//
+// INPUT PARAMETERS:
+// slot - address of the variable to register
+//------------------------------------------------------
+void addRootSlot(Ref* slot)
+{
+  assert(numObjMngrs != 0);
+  assert(slot != NULL);
+  if(numObjMngrs != 0 && slot != NULL)
+  {
+    lockPool();
+    if(numRootSlots == rootSlotsCapacity)
+    {
+      rootSlots = (Ref**)(growArray(rootSlots, &rootSlotsCapacity, sizeof(Ref*)));
+    }
+    rootSlots[numRootSlots] = slot;
+    numRootSlots++;
+    unlockPool();
+  }
+} // end of addRootSlot()
+
+//------------------------------------------------------
+// removeRootSlot
+//
+// PURPOSE: unregisters one registration of a root variable
+//
+// INPUT PARAMETERS:
+// slot - address of the variable to unregister
+//------------------------------------------------------
+void removeRootSlot(Ref* slot)
+{
+  int found = 0;
+  lockPool();
+  for(int i = 0; i < numRootSlots && !found; i++)
+  {
+    if(rootSlots[i] == slot)
+    {
+      rootSlots[i] = rootSlots[numRootSlots - 1];
+      numRootSlots--;
+      found = 1;
+    }
+  }
+  unlockPool();
+} // end of removeRootSlot()
+
+//------------------------------------------------------
+// growArray
+//
+// PURPOSE: doubles the capacity of a malloc'd array
+//
+// INPUT PARAMETERS:
+// array - the array to grow, may be NULL
+// capacity - number of elements the array holds, updated
+// elementSize - size of one element in bytes
+//
+// RETURN:
+// the grown array
+//------------------------------------------------------
+static void* growArray(void* array, int* capacity, int elementSize)
+{
+  int newCapacity = (*capacity == 0) ? 16 : *capacity * 2;
+  void* newArray = realloc(array, (size_t)newCapacity * elementSize);
+  assert(newArray != NULL);
+  *capacity = newCapacity;
+  return newArray;
+} // end of growArray()
+
+//------------------------------------------------------
+// traceFromRoots
+//
+// PURPOSE: in tracing mode, works out which objects are
+//          garbage when garbage collection is initiated.
+//          Everything reachable through ref fields from a
+//          registered root is alive and gets a count of 1,
+//          every other object gets a count of 0, after which
+//          the rest of the collector proceeds as usual.
+//          Objects already released (e.g. by endScope) stay
+//          garbage even if a root still refers to them.
+//------------------------------------------------------
+static void traceFromRoots()
+{
+  int length = 0;
+  Node** table = makeNodeTable(&length);
+  Node** worklist = (Node**)(malloc(sizeof(Node*) * (length + 1)));
+  assert(worklist != NULL);
+  int pending = 0;
+
+  for(int i = 0; i < length; i++)
+  {
+    table[i]->marked = 0;
+  }
+
+  // mark the roots themselves
+  for(int i = 0; i < numRoots + numRootSlots; i++)
+  {
+    Ref root = (i < numRoots) ? roots[i] : *(rootSlots[i - numRoots]);
+    Node* rootObj = searchNodeTable(table, length, root);
+    if(rootObj != NULL && rootObj->objReferenceCount != 0 && !rootObj->marked)
+    {
+      rootObj->marked = 1;
+      worklist[pending] = rootObj;
+      pending++;
+    }
+  }
+  markFrom(table, length, worklist, pending);
+
+  for(int i = 0; i < length; i++)
+  {
+    table[i]->objReferenceCount = table[i]->marked ? 1 : 0;
+    // storage only outlives its clones if some live clone uses it
+    if(!table[i]->marked && table[i]->isClone)
+    {
+      table[i]->storage = NULL;
+    }
+  }
+
+  free(worklist);
+  free(table);
+} // end of traceFromRoots()
+
+//------------------------------------------------------
+// setGcTriggerPolicy
+//
+// PURPOSE: sets when garbage collection fires before memory
+//          has actually run out.
+//
+// INPUT PARAMETERS:
+// deadPercent - insertObject collects first once garbage makes
+//               up this percentage of the used memory (0 = only
+//               when memory runs out)
+// idlePercent - gcMaybeCollect collects once garbage makes up
+//               this percentage of the used memory
+// headroomMs - gcMaybeCollect also collects if, at the rate
+//              memory has been allocated since the last
+//              collection, it would run out within this many
+//              milliseconds (0 = ignore the allocation rate)
+//------------------------------------------------------
+void setGcTriggerPolicy(int deadPercent, int idlePercent, ulong headroomMs)
+{
+  assert(deadPercent >= 0 && deadPercent <= 100);
+  assert(idlePercent >= 0 && idlePercent <= 100);
+
+  if(deadPercent >= 0 && deadPercent <= 100 && idlePercent >= 0 && idlePercent <= 100)
+  {
+    triggerDeadPercent = deadPercent;
+    idleDeadPercent = idlePercent;
+    idleHeadroomMs = headroomMs;
+  }
+} // end of setGcTriggerPolicy()
+
+//------------------------------------------------------
+// gcMaybeCollect
+//
+// PURPOSE: lets the caller fire garbage collection at a
+//          convenient time (e.g. when idle) if the trigger
+//          policy says it will be needed soon, so it doesn't
+//          have to happen in the middle of an allocation.
+//
+// RETURN:
+// 1 if garbage collection fired, 0 otherwise
+//------------------------------------------------------
+int gcMaybeCollect()
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterHomeShard();
+  PoolState* const pool = currentPool();
+  int collected = 0;
+
+  if(numObjMngrs != 0)
+  {
+    lockPool();
+    // logged drops may be what makes a collection worthwhile
+    if(deferredCounting && refLogLength > 0)
+    {
+      applyReferenceLog();
+    }
+    applyShardInbox();
+
+    if(estimatedGarbage() > 0)
+    {
+      int due = collectionDue(idleDeadPercent);
+      if(!due && idleHeadroomMs > 0)
+      {
+        // time left until memory runs out at the current allocation rate
+        double elapsedMs = (currentTimeNs() - pool->lastCollectionTime) / 1000000.0;
+        double freeBytes = MEMORY_SIZE - pool->nextAvailableIndex;
+        due = (pool->bytesSinceCollection > 0 && freeBytes / pool->bytesSinceCollection * elapsedMs < idleHeadroomMs);
+      }
+      if(due)
+      {
+        compact();
+        collected = 1;
+      }
+    }
+    unlockPool();
+  }
+  leaveShard(previous);
+  return collected;
+} // end of gcMaybeCollect()
+
+//------------------------------------------------------
+// setLowMemoryCallback
+//
+// PURPOSE: sets the function inserts call when collecting
+//          garbage didn't make room, so the program can drop
+//          references and have the insert retried.
+//
+// INPUT PARAMETERS:
+// callback - returns nonzero if it let go of something, NULL
+//            for none
+// context - passed to the callback
+//------------------------------------------------------
+void setLowMemoryCallback(LowMemoryCallback callback, void* context)
+{
+  lowMemoryCallback = callback;
+  lowMemoryContext = context;
+} // end of setLowMemoryCallback()
+
+//------------------------------------------------------
+// setEmergencyReserve
+//
+// PURPOSE: sets how many bytes at the end of the buffer are
+//          kept back from inserts until one would fail
+//          otherwise.
+//
+// INPUT PARAMETERS:
+// bytes - size of the reserve, less than MEMORY_SIZE (0 = none)
+//------------------------------------------------------
+void setEmergencyReserve(ulong bytes)
+{
+  assert(bytes < MEMORY_SIZE);
+  if(bytes < MEMORY_SIZE)
+  {
+    emergencyReserve = bytes;
+  }
+  else
+  {
+    printf("The emergency reserve must be smaller than the memory pool.\n");
+  }
+} // end of setEmergencyReserve()
+
+//------------------------------------------------------
+// isLowOnMemory
+//
+// PURPOSE: tells whether the used part of the pool (the
+//          calling thread's shard, for a sharded pool) runs
+//          into its emergency reserve.
+//
+// RETURN:
+// 1 if it is, 0 otherwise
+//------------------------------------------------------
+int isLowOnMemory()
+{
+  Shard* previous = enterHomeShard();
+  PoolState* const pool = currentPool();
+  int low = 0;
+
+  if(numObjMngrs != 0)
+  {
+    lockPool();
+    low = ((ulong)pool->nextAvailableIndex > MEMORY_SIZE - emergencyReserve);
+    unlockPool();
+  }
+  leaveShard(previous);
+  return low;
+} // end of isLowOnMemory()
+
+//------------------------------------------------------
+// estimatedGarbage
+//
+// PURPOSE: estimates how many bytes a garbage collection
+//          would free right now, without walking the index.
+//          In tracing mode nothing is known until the roots
+//          are traced, so everything allocated since the last
+//          collection is assumed to be garbage.
+//
+// RETURN:
+// the estimated number of bytes of garbage
+//------------------------------------------------------
+static ulong estimatedGarbage()
+{
+  PoolState* const pool = currentPool();
+  ulong garbage = pool->deadBytes;
+  if(collectionMode == COLLECT_TRACING)
+  {
+    garbage = pool->bytesSinceCollection;
+  }
+  return garbage;
+} // end of estimatedGarbage()
+
+//------------------------------------------------------
+// collectionDue
+//
+// PURPOSE: checks if garbage makes up enough of the used
+//          memory to be worth collecting.
+//
+// INPUT PARAMETERS:
+// percent - share of the used memory garbage has to reach
+//
+// RETURN:
+// 1 if there is at least that much garbage, 0 otherwise
+//------------------------------------------------------
+static int collectionDue(int percent)
+{
+  PoolState* const pool = currentPool();
+  ulong garbage = estimatedGarbage();
+  return (garbage > 0 && garbage * 100 >= (ulong)pool->nextAvailableIndex * percent);
+} // end of collectionDue()
+
+//------------------------------------------------------
+// currentTimeNs
+//
+// PURPOSE: reads a monotonic clock
+//
+// RETURN:
+// the current time in nanoseconds
+//------------------------------------------------------
+static ulong currentTimeNs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (ulong)now.tv_sec * 1000000000UL + (ulong)now.tv_nsec;
+} // end of currentTimeNs()
+
+//------------------------------------------------------
+// setHotObjectReordering
+//
+// PURPOSE: turns hot object reordering on or off.
+//
+// INPUT PARAMETERS:
+// samplePeriod - count one in every samplePeriod retrieveObject
+//                calls towards the object retrieved (0 = off)
+//------------------------------------------------------
+void setHotObjectReordering(ulong samplePeriod)
+{
+  accessSamplePeriod = samplePeriod;
+  accessTicker = 0;
+} // end of setHotObjectReordering()
+
+//------------------------------------------------------
+// makeWeakRef
+//
+// PURPOSE: creates a weak reference to an object. Reference
+//          ids are never handed out twice, so the id itself
+//          can serve as the weak reference: once the object
+//          is gone from the index nothing else will ever be
+//          found under it.
+//
+// INPUT PARAMETERS:
+// ref - reference to the object
+//
+// RETURN:
+// a weak reference to the object, or NULL_REF if the object
+// isn't alive
+//------------------------------------------------------
+WeakRef makeWeakRef(Ref ref)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(ref);
+  PoolState* const pool = currentPool();
+  WeakRef weak = NULL_REF;
+
+  if(numObjMngrs != 0 && ref != NULL_REF && ref < pool->referenceID)
+  {
+    lockPool();
+    Node* targetObj = findNode(ref);
+    if(targetObj != NULL && targetObj->objReferenceCount != 0)
+    {
+      weak = ref;
+    }
+    unlockPool();
+  }
+  leaveShard(previous);
+  return weak;
+} // end of makeWeakRef()
+
+//------------------------------------------------------
+// resolveWeak
+//
+// PURPOSE: returns a pointer to the object a weak reference
+//          refers to, as long as the garbage collector hasn't
+//          reclaimed it yet.
+//
+// INPUT PARAMETERS:
+// weak - the weak reference
+//
+// RETURN:
+// a pointer to the object, or NULL if it has been reclaimed
+//------------------------------------------------------
+void* resolveWeak(WeakRef weak)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(weak);
+  PoolState* const pool = currentPool();
+  void* ptr = NULL;
+
+  if(numObjMngrs != 0 && weak != NULL_REF && weak < pool->referenceID)
+  {
+    lockPool();
+    // unlike retrieveObject, garbage is fine until it is reclaimed
+    Node* target = findNode(weak);
+    if(target != NULL)
+    {
+      ptr = objectData(target);
+    }
+    unlockPool();
+  }
+  leaveShard(previous);
+  return ptr;
+} // end of resolveWeak()
+
+//------------------------------------------------------
+// promoteWeak
+//
+// PURPOSE: turns a weak reference into a counted reference.
+//          If the object was garbage but hasn't been
+//          reclaimed yet, it comes back to life. Its ref
+//          fields are only released when it is reclaimed, so
+//          whatever it pointed at is still there.
+//
+// INPUT PARAMETERS:
+// weak - the weak reference
+//
+// RETURN:
+// a reference to the object that the caller now holds, or
+// NULL_REF if it has been reclaimed
+//------------------------------------------------------
+Ref promoteWeak(WeakRef weak)
+{
+  assert(numObjMngrs != 0);
+  Shard* previous = enterShard(weak);
+  PoolState* const pool = currentPool();
+  Ref ref = NULL_REF;
+
+  if(numObjMngrs != 0 && weak != NULL_REF && weak < pool->referenceID)
+  {
+    lockPool();
+    Node* target = findNode(weak);
+    // a garbage clone may have let go of its contents already
+    if(target != NULL && objectData(target) != NULL)
+    {
+      if(target->objReferenceCount == 0)
+      {
+        // nobody held it any more, the caller is its only holder
+        target->objReferenceCount = 1;
+        pool->deadBytes = (pool->deadBytes > target->memSize) ? pool->deadBytes - target->memSize : 0;
+      }
+      else
+      {
+        traceSuspended++;
+        addReference(weak);
+        traceSuspended--;
+      }
+      ref = weak;
+    }
+    unlockPool();
+  }
+  leaveShard(previous);
+  return ref;
+} // end of promoteWeak()
+
+//------------------------------------------------------
+// setCheckLevel
+//
+// PURPOSE: sets how thoroughly invariants are checked
+//
+// INPUT PARAMETERS:
+// level - CHECK_NONE, CHECK_NODES, CHECK_SAMPLED or CHECK_FULL
+//------------------------------------------------------
+void setCheckLevel(int level)
+{
+  assert(level >= CHECK_NONE && level <= CHECK_FULL);
+  if(level >= CHECK_NONE && level <= CHECK_FULL)
+  {
+    checkLevel = level;
+    checkTicker = 0;
+  }
+} // end of setCheckLevel()
+
+//------------------------------------------------------
+// getCheckLevel
+//
+// PURPOSE: reports how thoroughly invariants are checked
+//
+// RETURN:
+// CHECK_NONE, CHECK_NODES, CHECK_SAMPLED or CHECK_FULL
+//------------------------------------------------------
+int getCheckLevel()
+{
+  return checkLevel;
+} // end of getCheckLevel()
+
+//------------------------------------------------------
+// setGcLogging
+//
+// PURPOSE: turns the statistics each garbage collection
+//          prints on or off
+//
+// INPUT PARAMETERS:
+// enabled - 1 to print them (the default), 0 not to
+//------------------------------------------------------
+void setGcLogging(int enabled)
+{
+  gcLogging = enabled;
+} // end of setGcLogging()
+
+//------------------------------------------------------
+// getGcStats
+//
+// PURPOSE: reports how many garbage collections the pool in
+//          use has run and how long the last one took. For a
+//          sharded pool that is the collections of all the
+//          shards and the last one any of them ran.
+//
+// INPUT PARAMETERS:
+// collections - set to the number of garbage collections
+// lastPauseNs - set to the duration of the last one (ns)
+//------------------------------------------------------
+void getGcStats(ulong* collections, ulong* lastPauseNs)
+{
+  assert(numObjMngrs != 0);
+  ulong totalCollections = 0;
+  ulong latestPauseNs = 0;
+  ulong latestTime = 0;
+
+  for(int shard = 0; numObjMngrs != 0 && shard < ((numShards > 0) ? numShards : 1); shard++)
+  {
+    Shard* previous = enterShard((Ref)shard << SHARD_SHIFT);
+    PoolState* const pool = currentPool();
+    lockPool();
+    totalCollections = totalCollections + pool->numCollections;
+    if(pool->numCollections > 0 && pool->lastCollectionTime >= latestTime)
+    {
+      latestTime = pool->lastCollectionTime;
+      latestPauseNs = pool->lastPauseNs;
+    }
+    unlockPool();
+    leaveShard(previous);
+  }
+  if(numObjMngrs != 0 && collections != NULL)
+  {
+    *collections = totalCollections;
+  }
+  if(numObjMngrs != 0 && lastPauseNs != NULL)
+  {
+    *lastPauseNs = latestPauseNs;
+  }
+} // end of getGcStats()
+
+//------------------------------------------------------
+// startOperationTrace
+//
+// PURPOSE: starts recording the operations the caller
+//          performs on the pool to a file, replacing it.
+//          Recording goes on across pools until
+//          stopOperationTrace is called.
+//
+// INPUT PARAMETERS:
+// path - the file to record to
+//
+// RETURN:
+// 1 if recording started, 0 otherwise
+//------------------------------------------------------
+int startOperationTrace(const char* path)
+{
+  assert(path != NULL);
+  int started = 0;
+
+  if(path != NULL)
+  {
+    stopOperationTrace();
+    traceFile = fopen(path, "w");
+    if(traceFile != NULL)
+    {
+      setvbuf(traceFile, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+      ulong header[2] = { TRACE_MAGIC, MEMORY_SIZE };
+      started = (fwrite(header, sizeof(header), 1, traceFile) == 1);
+      traceStartNs = currentTimeNs();
+      traceSuspended = 0;
+      if(!started)
+      {
+        fclose(traceFile);
+        traceFile = NULL;
+      }
+    }
+    if(!started)
+    {
+      printf("Unable to record operations to %s\n", path);
+    }
+  }
+  return started;
+} // end of startOperationTrace()
+
+//------------------------------------------------------
+// stopOperationTrace
+//
+// PURPOSE: stops recording operations and writes out the
+//          ones still buffered
+//
+// RETURN:
+// 1 if every operation recorded made it to the file, 0
+// otherwise
+//------------------------------------------------------
+int stopOperationTrace()
+{
+  int complete = 1;
+  if(traceFile != NULL)
+  {
+    complete = !ferror(traceFile);
+    complete = (fclose(traceFile) == 0) && complete;
+    traceFile = NULL;
+  }
+  return complete;
+} // end of stopOperationTrace()
+
+//------------------------------------------------------
+// traceOperation
+//
+// PURPOSE: records an operation if recording is on. An
+//          operation is four words: the nanoseconds since
+//          recording started shifted left 8 bits with the
+//          operation in the low byte, the reference, and the
+//          operation's two arguments.
+//
+// INPUT PARAMETERS:
+// op - one of the TRACE_* operations
+// ref - the reference the operation was on (for inserts and
+//       clones, the reference handed out)
+// first - bytes asked for by inserts and resizes, the slot
+//         for setRefField, the object cloned for clones
+// second - ref slots asked for by inserts, the value stored
+//          for setRefField, 0 otherwise
+//------------------------------------------------------
+static void traceOperation(ulong op, Ref ref, ulong first, ulong second)
+{
+  // calls the object manager makes itself aren't the caller's, and a
+  // replay has one pool, so sharded pools aren't recorded
+  if(traceFile != NULL && traceSuspended == 0 && numShards == 0)
+  {
+    ulong record[4] = { ((currentTimeNs() - traceStartNs) << 8) | op, ref, first, second };
+    fwrite(record, sizeof(record), 1, traceFile);
+  }
+} // end of traceOperation()
+
+//------------------------------------------------------
+// getTraceEvents
+//
+// PURPOSE: copies out the latest events from the tracepoint
+//          event log, oldest first
+//
+// INPUT PARAMETERS:
+// events - where to copy the events to
+// maxEvents - room in events
+//
+// RETURN:
+// the number of events copied
+//------------------------------------------------------
+ulong getTraceEvents(TraceEvent* events, ulong maxEvents)
+{
+  ulong numCopied = 0;
+
+  if(events != NULL)
+  {
+    lockPool();
+    ulong numKept = (numTraceEvents < TRACE_EVENT_LOG_SIZE) ? numTraceEvents : TRACE_EVENT_LOG_SIZE;
+    numCopied = (numKept < maxEvents) ? numKept : maxEvents;
+    for(ulong i = 0; i < numCopied; i++)
+    {
+      events[i] = traceEvents[(numTraceEvents - numCopied + i) & (TRACE_EVENT_LOG_SIZE - 1)];
+    }
+    unlockPool();
+  }
+  return numCopied;
+} // end of getTraceEvents()
+
+//------------------------------------------------------
+// recordTraceEvent
+//
+// PURPOSE: adds an event to the tracepoint event log,
+//          overwriting the oldest once it is full
+//
+// INPUT PARAMETERS:
+// type - one of the EVENT_* types
+// first - the event's first value
+// second - the event's second value
+//------------------------------------------------------
+static void recordTraceEvent(int type, ulong first, ulong second)
+{
+  // shards of a sharded pool record events at the same time
+  ulong slot = __atomic_fetch_add(&numTraceEvents, 1, __ATOMIC_RELAXED);
+  TraceEvent* event = &(traceEvents[slot & (TRACE_EVENT_LOG_SIZE - 1)]);
+  event->timeNs = currentTimeNs();
+  event->type = type;
+  event->first = first;
+  event->second = second;
+} // end of recordTraceEvent()
+
+//------------------------------------------------------
+// raiseHighWater
+//
+// PURPOSE: keeps the active buffer's high water mark up with
+//          the next available index. Going past it writes
+//          pages that aren't in memory (never used, or given
+//          back by releaseUnusedPages), i.e. the heap grows,
+//          which is what the heap growth tracepoint reports.
+//------------------------------------------------------
+static void raiseHighWater()
+{
+  PoolState* const pool = currentPool();
+  if((ulong)pool->nextAvailableIndex > pool->activeHighWater)
+  {
+    ulong oldEnd = roundUp(pool->activeHighWater, pool->bufferPageSize);
+    ulong newEnd = roundUp(pool->nextAvailableIndex, pool->bufferPageSize);
+    if(newEnd > oldEnd)
+    {
+      TRACEPOINT(EVENT_HEAP_GROWTH, heap_growth, oldEnd, newEnd);
+    }
+    pool->activeHighWater = pool->nextAvailableIndex;
+  }
+} // end of raiseHighWater()
+
+//------------------------------------------------------
+// setHeapProfiling
+//
+// PURPOSE: turns heap profiling on or off. Sampled objects
+//          remember the allocation site in effect when they
+//          were allocated, and writeHeapProfile reports on
+//          them.
+//
+// INPUT PARAMETERS:
+// samplePeriod - profile one in every samplePeriod allocations
+//                (0 = off)
+//------------------------------------------------------
+void setHeapProfiling(ulong samplePeriod)
+{
+  profileSamplePeriod = samplePeriod;
+  profileTicker = 0;
+} // end of setHeapProfiling()
+
+//------------------------------------------------------
+// setAllocationSite
+//
+// PURPOSE: sets the allocation site given to the objects
+//          allocated from now on. Only the pointer is kept.
+//
+// INPUT PARAMETERS:
+// site - name of the site (e.g. a string literal), NULL for
+//        "unknown"
+//------------------------------------------------------
+void setAllocationSite(const char* site)
+{
+  allocationSite = (site != NULL) ? site : "unknown";
+} // end of setAllocationSite()
+
+//------------------------------------------------------
+// writeHeapProfile
+//
+// PURPOSE: writes a profile of the live sampled objects:
+//          how many there are and how many bytes they take
+//          up for each allocation site, and the same for
+//          their ages, i.e. how many garbage collections they
+//          have survived, in power of 2 buckets. Numbers are
+//          estimates for all objects (the sampled ones times
+//          the sample period). Sites are written in name
+//          order, one per line, so two profiles can be
+//          compared with diff.
+//
+// INPUT PARAMETERS:
+// path - the file to write the profile to, NULL for the
+//        standard output
+//
+// RETURN:
+// 1 if the profile was written, 0 otherwise
 //------------------------------------------------------
-static void copyActToNonact()
+int writeHeapProfile(const char* path)
 {
-  checkIndex(indexing);
-  Node* curr = indexing->top;
-  int newStartInd = 0; // new start index for an object in the inactive buffer
-  int sizeTracker = 0; // size tracker for inactive buffer and where next avail index is
-  int numObjects = 0;  // non garbage objects detected
-  ulong numBytes = 0;  // bytes in use
-  ulong numBytesCollected = 0; // bytes collected by GC
+  PoolState* const pool = currentPool();
+  assert(numObjMngrs != 0);
+  int written = 0;
 
-  // iterating index
-  while(curr != NULL)
+  if(numObjMngrs != 0)
   {
-    // we copy non garbage only
-    if(curr->objReferenceCount != 0)
+    FILE* out = (path != NULL) ? fopen(path, "w") : stdout;
+    if(out != NULL)
     {
-      numObjects++;
-      numBytes = numBytes + curr->memSize;
-      //copy from active to inactive
-      for(int i = curr->memStartIndex; i < (curr->memStartIndex + curr->memSize); i++)
+      lockPool();
+      int length = 0;
+      Node** table = makeNodeTable(&length);
+      // keep the live sampled objects only
+      int numSampled = 0;
+      for(int i = 0; i < length; i++)
+      {
+        if(table[i]->site != NULL && table[i]->objReferenceCount != 0 && !table[i]->hidden)
+        {
+          table[numSampled] = table[i];
+          numSampled++;
+        }
+      }
+      qsort(table, numSampled, sizeof(Node*), compareSites);
+
+      ulong scale = (profileSamplePeriod != 0) ? profileSamplePeriod : 1;
+      ulong ageObjects[64] = { 0 };
+      ulong ageBytes[64] = { 0 };
+      int ok = (fprintf(out, "heap profile: sample period %lu, collections %lu\n", scale, pool->numCollections) > 0);
+      int start = 0;
+      while(start < numSampled)
+      {
+        ulong siteObjects = 0;
+        ulong siteBytes = 0;
+        int end = start;
+        while(end < numSampled && strcmp(table[end]->site, table[start]->site) == 0)
+        {
+          siteObjects++;
+          siteBytes = siteBytes + table[end]->memSize;
+          int bucket = ageBucket(pool->numCollections - table[end]->birth);
+          ageObjects[bucket]++;
+          ageBytes[bucket] = ageBytes[bucket] + table[end]->memSize;
+          end++;
+        }
+        ok = ok && fprintf(out, "site %s objects %lu bytes %lu\n", table[start]->site, siteObjects * scale, siteBytes * scale) > 0;
+        start = end;
+      }
+      for(int bucket = 0; bucket < 64; bucket++)
       {
-        inactiveBuffer[sizeTracker] = activeBuffer[i];
-        sizeTracker++; 
+        if(ageObjects[bucket] != 0)
+        {
+          ulong low = (bucket == 0) ? 0 : (1UL << (bucket - 1));
+          ulong high = (bucket == 0) ? 0 : (1UL << bucket) - 1;
+          ok = ok && fprintf(out, "age %lu-%lu objects %lu bytes %lu\n", low, high, ageObjects[bucket] * scale, ageBytes[bucket] * scale) > 0;
+        }
+      }
+      free(table);
+      unlockPool();
+
+      if(path != NULL)
+      {
+        ok = (fclose(out) == 0) && ok;
       }
-      // update the object's new offset
-      curr->memStartIndex = newStartInd;
-      newStartInd = newStartInd + curr->memSize;
+      written = ok;
     }
-    else
+    if(!written)
     {
-      // if garbage we collect it and do not copy over
-      numBytesCollected = numBytesCollected + curr->memSize;
+      printf("Unable to write the heap profile to %s\n", path);
     }
-    curr = curr->next;
   }
-
-  // update global variable for object manager
-  nextAvailableIndex = sizeTracker;     
-
-  // printing garbage collection statistics
-  printf("Objects: %d   Bytes in Use: %lu   Freed: %lu\n", numObjects, numBytes, numBytesCollected);
-  checkIndex(indexing);
-}// end of copyActToNonact()
+  return written;
+} // end of writeHeapProfile()
 
 //------------------------------------------------------
-// swapBuffers
+// compareSites
 //
-// PURPOSE: when garbage collection is initiated, this function
-//          helps with swapping the active and inactive buffers
-//          after we have already copied non garbage from current
-//          active buffer to the inactive buffer.
+// PURPOSE: qsort comparison function ordering nodes by the
+//          name of their allocation site, then by reference
+//          id.
+//
+// RETURN:
+// negative, zero or positive as a orders before, with or
+// after b
 //------------------------------------------------------
-static void swapBuffers()
+static int compareSites(const void* a, const void* b)
 {
-  assert(activeBuffer != NULL);
-  assert(inactiveBuffer != NULL);
+  const Node* first = *(const Node* const*)a;
+  const Node* second = *(const Node* const*)b;
+  int result = strcmp(first->site, second->site);
 
-  //swapping
-  uchar* temp = activeBuffer;
-  activeBuffer = inactiveBuffer;
-  inactiveBuffer = temp;
-  assert(activeBuffer != NULL);
-  assert(inactiveBuffer != NULL);
-}// swapBuffers()
+  if(result == 0 && first->objReferenceID != second->objReferenceID)
+  {
+    result = (first->objReferenceID < second->objReferenceID) ? -1 : 1;
+  }
+  return result;
+} // end of compareSites()
 
 //------------------------------------------------------
-// garbageExists
+// ageBucket
+//
+// PURPOSE: works out which age bucket of the heap profile an
+//          age falls in. Bucket 0 holds age 0 and bucket b
+//          holds ages 2^(b-1) to 2^b - 1.
 //
-// PURPOSE: this function checks if there are any objects
-//          that have gone out of scope (i.e. garbage)
+// INPUT PARAMETERS:
+// age - garbage collections survived
 //
 // RETURN:
-// returns 0 if no garbage and 1 otherwise
+// the bucket
 //------------------------------------------------------
-static int garbageExists()
+static int ageBucket(ulong age)
 {
-  checkIndex(indexing);
-  int present = 0;
-
-  // iterate the index to see if there are any objects
-    //with a ref count of 0. we exit as soon as we find one
-  Node* curr = indexing->top;
-  while(curr != NULL && present != 1)
+  int bucket = 0;
+  while(age > 0)
   {
-    if(curr->objReferenceCount == 0)
-    {
-      present = 1;
-    }
-    curr = curr->next;
+    bucket++;
+    age = age >> 1;
   }
-  checkIndex(indexing);
-  return present;
-} // end of garbageExists()
+  return bucket;
+} // end of ageBucket()
 
 //------------------------------------------------------
-// dumpPool()
+// beginScope
 //
-// PURPOSE: This function traverses the index and prints the
-//          info in each non-garbage entry corresponding to
-//          a block of allocated memory.
+// PURPOSE: opens a new scope. Every object allocated from
+//          now until the matching endScope() belongs to it.
+//          Since reference ids are handed out in increasing
+//          order, remembering the next id to be given out is
+//          all we need to recognise the scope's objects later.
+//
+// RETURN:
+// the depth of the scope that was opened, or 0 if no scope
+// could be opened
 //------------------------------------------------------
-void dumpPool()
+int beginScope()
 {
+  PoolState* const pool = currentPool();
   assert(numObjMngrs != 0);
-  if(numObjMngrs != 0)
-  {
-    checkIndex(indexing);
-    //keeps track of the ith non-garbage object we found
-    int counter = 1;
+  assert(scopeDepth < MAX_SCOPE_DEPTH);
+  int depth = 0;
 
-    Node* curr = indexing->top;
-    while(curr != NULL)
-    {
-      // print info if object is still in scope
-      if(curr->objReferenceCount != 0)
-      {
-        printf("\nObject #%d Info:\n", counter);
-        counter++;
-        printf("Starting index - %d\n", curr->memStartIndex);
-        printf("Starting Address - %p\n", &(activeBuffer[curr->memStartIndex]));
-        printf("Reference ID - %lu\n", curr->objReferenceID);
-        printf("Size - %lu\n", curr->memSize);
-        printf("Reference Count - %d\n", curr->objReferenceCount);
-      }
-      curr = curr->next;
-    }
-    checkIndex(indexing);
+  lockPool();
+  // in a shared pool other processes allocate too, so the scope's
+  // objects couldn't be told apart by their reference ids, and in a
+  // sharded one they are spread over the shards
+  if(numObjMngrs != 0 && scopeDepth < MAX_SCOPE_DEPTH && !pool->shared && numShards == 0)
+  {
+    scopeStack[scopeDepth] = pool->referenceID;
+    scopeDepth++;
+    depth = scopeDepth;
   }
   else
   {
-    printf("No object manager initialised. Nothing available in memory pool to dump!\n");
+    printf("Unable to open a scope. Either no object manager is initialised, the pool is shared or sharded or too many scopes are open.\n");
   }
-} // end of dumpPool()
+  unlockPool();
+  return depth;
+} // end of beginScope()
 
 //------------------------------------------------------
-// retrieveObject
-//
-// PURPOSE: returns a pointer to the object in memory being
-//          requested given by the reference id
+// endScope
 //
-// INPUT PARAMETERS:
-// ref - the reference id for the object to which we want
-//       the pointer for
+// PURPOSE: closes the innermost open scope and releases
+//          every object allocated inside it in one go.
+//          Objects are kept in the index in the order they
+//          were allocated, so the scope's objects are the
+//          tail of the index. If those objects also fill the
+//          tail of the active buffer exactly, we hand the
+//          memory back immediately by rewinding the next
+//          available index and dropping their nodes;
+//          otherwise they are left for the garbage collector.
 //
-// RETURN:
-// a void pointer to where the x amount of memory was allocated
-// for the object.
+// (No return type or input/output parameters)
 //------------------------------------------------------
-void* retrieveObject(Ref ref)
+void endScope()
 {
+  PoolState* const pool = currentPool();
   assert(numObjMngrs != 0);
-  void* ptr = NULL;
+  assert(scopeDepth > 0);
 
-  if(numObjMngrs != 0)
+  lockPool();
+  if(numObjMngrs != 0 && scopeDepth > 0)
   {
-    // reference being used hasn't been given out yet
-    assert(ref < referenceID);
-    assert(ref != NULL_REF);
-    // procced if ref is not null
-    if(ref != NULL_REF)
+    checkIndex(pool->indexing);
+    scopeDepth--;
+    pool->reserveBackoff = 0;
+    Ref firstRef = scopeStack[scopeDepth];
+
+    // skip the objects allocated before the scope was opened
+    Node* curr = pool->indexing->top;
+    Node* prev = NULL;
+    while(curr != NULL && curr->objReferenceID < firstRef)
     {
-      // find the node in the index with the ref of interest
-      Node* target = findNode(ref);
-      // if the node was found and it is not out of scope
-      if(target != NULL && target->objReferenceCount != 0)
+      prev = curr;
+      curr = curr->next;
+    }
+
+    // release everything allocated in the scope, keeping track of
+    // the region of the buffer that the scope's objects occupy
+    Node* first = curr;
+    int regionStart = pool->nextAvailableIndex;
+    ulong regionBytes = 0;
+    ulong releasedBytes = 0; // bytes that were still alive
+    int keptStorage = 0; // storage made for clones isn't the scope's to release
+    while(curr != NULL)
+    {
+      if(curr->hidden)
+      {
+        keptStorage = 1;
+      }
+      else if(!curr->isClone)
+      {
+        if(curr->memStartIndex < regionStart)
+        {
+          regionStart = curr->memStartIndex;
+        }
+        regionBytes = regionBytes + curr->memSize;
+        if(curr->objReferenceCount != 0)
+        {
+          releasedBytes = releasedBytes + curr->memSize;
+        }
+        curr->objReferenceCount = 0;
+      }
+      else
+      {
+        curr->objReferenceCount = 0;
+      }
+      curr = curr->next;
+    }
+
+    // the scope's objects exactly cover the tail of the buffer, rewind
+    if(first != NULL && !keptStorage && regionStart + regionBytes == (ulong)pool->nextAvailableIndex)
+    {
+      pool->nextAvailableIndex = regionStart;
+      // garbage from earlier in the scope is gone as well
+      ulong alreadyDead = regionBytes - releasedBytes;
+      pool->deadBytes = (pool->deadBytes > alreadyDead) ? pool->deadBytes - alreadyDead : 0;
+      if(prev == NULL)
+      {
+        pool->indexing->top = NULL;
+      }
+      else
+      {
+        prev->next = NULL;
+      }
+      pool->indexing->last = prev;
+      invalidateTranslationCache();
+      while(first != NULL)
       {
-        checkNode(target);
-        ptr = &(activeBuffer[target->memStartIndex]);
-        assert(ptr != NULL);
+        curr = first;
+        first = first->next;
+        releaseRefFields(curr);
+        destroyNode(curr);
       }
     }
     else
     {
-      assert(ptr == NULL);
+      pool->deadBytes = pool->deadBytes + releasedBytes;
     }
+    checkIndex(pool->indexing);
   }
-  return ptr;
-} // end of retrieveObject
+  unlockPool();
+} // end of endScope()
 
 //------------------------------------------------------
-// findNode
+// setDeferredReferenceCounting
 //
-// PURPOSE: searches the index for a node with the specific
-//          ref id.
+// PURPOSE: turns deferred reference counting on or off.
+//          Turning it off applies whatever is still logged.
 //
 // INPUT PARAMETERS:
-// ref - the reference id we are searching for
-//
-// RETURN:
-// if found, a pointer to the target node, null otherwise
+// enabled - 1 to log reference count changes, 0 to apply
+//           them immediately
 //------------------------------------------------------
-static Node* findNode(Ref ref)
+void setDeferredReferenceCounting(int enabled)
 {
-  assert(ref < referenceID);
-  assert(ref != NULL_REF);
-
-  Node* returnNode = NULL;
-  if(ref != NULL_REF)
+  lockPool();
+  if(!enabled && numObjMngrs != 0)
   {
-    checkIndex(indexing);
-    Node* curr = indexing->top;
-    // iterate until we reach the end or find the target ref
-    while(curr != NULL && curr->objReferenceID != ref)
-    {
-      curr = curr->next;
-    }
-    returnNode = curr;
-    checkIndex(indexing);
+    applyReferenceLog();
   }
-  return returnNode;
+  deferredCounting = (enabled != 0);
+  unlockPool();
+} // end of setDeferredReferenceCounting()
 
-} // end of findNode()
+//------------------------------------------------------
+// flushReferenceLog
+//
+// PURPOSE: applies all logged reference count changes now
+//          rather than waiting for the log to fill up or
+//          the garbage collector to run.
+//------------------------------------------------------
+void flushReferenceLog()
+{
+  assert(numObjMngrs != 0);
+  if(numObjMngrs != 0)
+  {
+    lockPool();
+    applyReferenceLog();
+    unlockPool();
+  }
+} // end of flushReferenceLog()
 
 //------------------------------------------------------
-// addReference
+// logReferenceChange
 //
-// PURPOSE: updates our index to indicate that we have another
-//          reference to the given object
+// PURPOSE: records a reference count change to be applied
+//          later. A full log is applied first to make room.
 //
 // INPUT PARAMETERS:
-// ref - reference to the object for which we want to increment
-//       number of references
+// ref - reference to the object whose count changes
+// delta - +1 for a new reference, -1 for a dropped one
 //------------------------------------------------------
-void addReference(Ref ref)
+static void logReferenceChange(Ref ref, int delta)
 {
-  assert(numObjMngrs != 0);
-
-  if(numObjMngrs != 0)
+  if(refLogLength == REF_LOG_SIZE)
   {
-    // reference being used hasn't been given out yet
-    assert(ref < referenceID);
-    assert(ref != NULL_REF);
+    applyReferenceLog();
+  }
+  refLog[refLogLength].ref = ref;
+  refLog[refLogLength].delta = delta;
+  refLog[refLogLength].sequence = refLogLength;
+  refLogLength++;
+} // end of logReferenceChange()
 
-    if(ref != NULL_REF)
+//------------------------------------------------------
+// applyReferenceLog
+//
+// PURPOSE: applies every logged reference count change as
+//          one batch. The log is sorted by reference id, and
+//          since the index is also ordered by reference id a
+//          single walk of the index applies the whole batch.
+//          An object taken to 0 by the batch goes in the zero
+//          count table instead of being treated as garbage
+//          straight away, so a later increment in the same
+//          batch can still bring it back. Once the batch is
+//          done, objects left at 0 in the table are garbage.
+//          Objects that were already garbage before the batch
+//          are left alone, as addReference would.
+//------------------------------------------------------
+static void applyReferenceLog()
+{
+  PoolState* const pool = currentPool();
+  checkIndex(pool->indexing);
+  qsort(refLog, refLogLength, sizeof(RefLogEntry), compareLogEntries);
+
+  Node* curr = pool->indexing->top;
+  for(int i = 0; i < refLogLength; i++)
+  {
+    // find the node for this change (or the place it would be)
+    while(curr != NULL && curr->objReferenceID < refLog[i].ref)
     {
-      //find the node of interest
-      Node* targetObj = findNode(ref);
-      // if node is found and it is still in scope
-      if(targetObj != NULL && targetObj->objReferenceCount != 0)
+      curr = curr->next;
+    }
+    if(curr != NULL && curr->objReferenceID == refLog[i].ref)
+    {
+      if(curr->objReferenceCount != 0 || curr->inZeroCountTable)
       {
-        checkNode(targetObj);
-        targetObj->objReferenceCount++;
-        checkNode(targetObj);
+        curr->objReferenceCount = curr->objReferenceCount + refLog[i].delta;
+        if(curr->objReferenceCount <= 0)
+        {
+          curr->objReferenceCount = 0;
+          if(!curr->inZeroCountTable)
+          {
+            curr->inZeroCountTable = 1;
+            zeroCountTable[zeroCountLength] = curr;
+            zeroCountLength++;
+          }
+        }
       }
     }
   }
-} //end of addReference
+  refLogLength = 0;
+
+  // whatever is still at 0 stays garbage, empty the table
+  for(int i = 0; i < zeroCountLength; i++)
+  {
+    if(zeroCountTable[i]->objReferenceCount == 0)
+    {
+      pool->deadBytes = pool->deadBytes + zeroCountTable[i]->memSize;
+    }
+    zeroCountTable[i]->inZeroCountTable = 0;
+  }
+  zeroCountLength = 0;
+  checkIndex(pool->indexing);
+} // end of applyReferenceLog()
 
 //------------------------------------------------------
-// dropReference
+// compareLogEntries
 //
-// PURPOSE: updates our index to indicate that we have lost
-//          a reference to the given object
+// PURPOSE: qsort comparison function ordering logged changes
+//          by reference id, then by the order they were made.
 //
-// INPUT PARAMETERS:
-// ref - reference to the object for which we want to decrement
-//       number of references
+// RETURN:
+// negative, zero or positive as a orders before, with or
+// after b
 //------------------------------------------------------
-void dropReference(Ref ref)
+static int compareLogEntries(const void* a, const void* b)
 {
-  assert(numObjMngrs != 0);
+  const RefLogEntry* first = (const RefLogEntry*)a;
+  const RefLogEntry* second = (const RefLogEntry*)b;
+  int result = first->sequence - second->sequence;
 
-  if(numObjMngrs != 0)
+  if(first->ref != second->ref)
   {
-    // reference being used hasn't been given out yet
-    assert(ref < referenceID);
-    assert(ref != NULL_REF);
-
-    if(ref != NULL_REF)
-    {
-      // find the node of interest
-      Node* targetObj = findNode(ref);
-      // if node is found and it is still in scope
-      if(targetObj != NULL && targetObj->objReferenceCount != 0)
-      {
-        checkNode(targetObj);
-        targetObj->objReferenceCount--;
-        checkNode(targetObj);
-      }
-    }
-  } 
-} // end of dropReference()
+    result = (first->ref < second->ref) ? -1 : 1;
+  }
+  return result;
+} // end of compareLogEntries()
 
 //------------------------------------------------------
 // makeNode
@@ -602,31 +5133,75 @@ void dropReference(Ref ref)
 //------------------------------------------------------
 static Node* makeNode(ulong memSize)
 {
+  PoolState* const pool = currentPool();
   assert(memSize >= 0);
-  Node* newNode = (Node*)(malloc(sizeof(Node)));
+  Node* newNode = NULL;
+  if(pool->shared)
+  {
+    // nodes of a shared pool must be in the segment
+    assert(nodesAvailable(1));
+    newNode = pool->freeNodes;
+    pool->freeNodes = (newNode != NULL) ? newNode->next : NULL;
+  }
+  else
+  {
+    newNode = (Node*)(malloc(sizeof(Node)));
+  }
   assert(newNode != NULL);
   if(newNode != NULL)
   {
-    newNode->memStartIndex = nextAvailableIndex;
+    newNode->memStartIndex = pool->nextAvailableIndex;
     // update global variable for next available index in the buffer
-    nextAvailableIndex = nextAvailableIndex + memSize;
+    pool->nextAvailableIndex = pool->nextAvailableIndex + memSize;
+    raiseHighWater();
     newNode->memSize = memSize;
     newNode->objReferenceCount = 1;
-    newNode->objReferenceID = referenceID;
+    newNode->objReferenceID = pool->referenceID;
+    newNode->refSlotCount = 0;
+    newNode->inZeroCountTable = 0;
+    newNode->externalCount = 0;
+    newNode->marked = 0;
+    newNode->accessCount = 0;
+    newNode->isClone = 0;
+    newNode->storage = NULL;
+    newNode->hidden = 0;
+    newNode->site = NULL;
+    newNode->birth = pool->numCollections;
     // update global variable for reference id to avoid duplicate ref ids
-    referenceID++;
+    pool->referenceID++;
     newNode->next = NULL;
   }
-  else
-  {
-    free(newNode);
-    newNode = NULL;
-  }
   checkNode(newNode);
   return newNode;
 
 } // end of makeNode()
 
+//------------------------------------------------------
+// nodesAvailable
+//
+// PURPOSE: checks if makeNode can make more nodes. Nodes
+//          are malloc'd for a private pool, but a shared pool
+//          only has the nodes in its segment.
+//
+// INPUT PARAMETERS:
+// numNodes - the number of nodes needed
+//
+// RETURN:
+// 1 if that many nodes can be made, 0 otherwise
+//------------------------------------------------------
+static int nodesAvailable(int numNodes)
+{
+  PoolState* const pool = currentPool();
+  Node* curr = pool->shared ? pool->freeNodes : NULL;
+  int numFree = 0;
+  while(curr != NULL && numFree < numNodes)
+  {
+    numFree++;
+    curr = curr->next;
+  }
+  return (!pool->shared || numFree >= numNodes);
+} // end of nodesAvailable()
+
 //------------------------------------------------------
 // destroyNode
 //
@@ -637,9 +5212,18 @@ static Node* makeNode(ulong memSize)
 //------------------------------------------------------
 static void destroyNode(Node* aNode)
 {
+  PoolState* const pool = currentPool();
   // destroy if node is valid
   checkNode(aNode);
-  free(aNode);
+  if(pool->shared)
+  {
+    aNode->next = pool->freeNodes;
+    pool->freeNodes = aNode;
+  }
+  else
+  {
+    free(aNode);
+  }
 
 } // end of destroyNode()
 
@@ -655,12 +5239,19 @@ static void destroyNode(Node* aNode)
 static void checkNode(Node* aNode)
 {
   assert(aNode != NULL);
-  assert(aNode->memStartIndex >= 0);
-  assert(aNode->memSize > 0);
-  assert(aNode->memSize <= MEMORY_SIZE);
-  assert(aNode->objReferenceCount >= 0);
-  assert(aNode->objReferenceID > 0);
-  assert(aNode->objReferenceID < referenceID);
+  if(checkLevel != CHECK_NONE)
+  {
+    assert(aNode->memStartIndex >= 0);
+    assert(aNode->memSize > 0);
+    assert(aNode->memSize <= MEMORY_SIZE);
+    assert(aNode->refSlotCount <= aNode->memSize / sizeof(Ref));
+    assert(aNode->objReferenceCount >= 0);
+    assert(aNode->objReferenceID > 0);
+    assert(aNode->objReferenceID < currentPool()->referenceID);
+    // a live clone holds on to its storage, which isn't a clone itself
+    assert(!aNode->isClone || aNode->storage != NULL || aNode->objReferenceCount == 0);
+    assert(aNode->storage == NULL || (aNode->storage->hidden && !aNode->hidden));
+  }
 
 } //end of checkNode()
 
@@ -680,6 +5271,7 @@ static Index* makeIndex()
   {
     // index is empty when created
     newIndex->top = NULL;
+    newIndex->last = NULL;
   }
   else
   {
@@ -695,7 +5287,9 @@ static Index* makeIndex()
 // destroyIndex
 //
 // PURPOSE: destroys any memory/resources being used by the
-//          index instance and its contents 
+//          index instance and its contents. The storage nodes
+//          of clones go last, since checking a clone looks at
+//          its storage.
 //
 // INPUT PARAMETERS:
 // A pointer to the index being destroyed
@@ -704,13 +5298,29 @@ void destroyIndex(Index* anIndex)
 {
   checkIndex(anIndex);
 
-  // destroying each individual node in the linked list
+  // destroying each individual node in the linked list, putting
+  // storage nodes aside on a list of their own
   Node* curr = anIndex->top;
   Node* prev = NULL;
+  Node* storageNodes = NULL;
   while(curr != NULL)
   {
     prev = curr;
     curr = curr->next;
+    if(prev->hidden)
+    {
+      prev->next = storageNodes;
+      storageNodes = prev;
+    }
+    else
+    {
+      destroyNode(prev);
+    }
+  }
+  while(storageNodes != NULL)
+  {
+    prev = storageNodes;
+    storageNodes = storageNodes->next;
     destroyNode(prev);
   }
   free(anIndex);
@@ -721,7 +5331,9 @@ void destroyIndex(Index* anIndex)
 // checkIndex
 //
 // PURPOSE: invariant for the index struct. checks if an
-//          index is valid.
+//          index is valid. Depending on the check level,
+//          either every node or just the ends of the index
+//          are checked.
 //
 // INPUT PARAMETERS:
 // A pointer to the index being checked
@@ -730,14 +5342,45 @@ static void checkIndex(Index* anIndex)
 {
   assert(anIndex != NULL);
 
-  if(anIndex->top != NULL)
+  int fullWalk = (checkLevel == CHECK_FULL);
+  if(checkLevel == CHECK_SAMPLED)
+  {
+    checkTicker++;
+    if(checkTicker >= CHECK_SAMPLE_PERIOD)
+    {
+      checkTicker = 0;
+      fullWalk = 1;
+    }
+  }
+
+  if(checkLevel != CHECK_NONE && !fullWalk)
+  {
+    // the ends of the index are all we can check in constant time
+    assert((anIndex->top == NULL) == (anIndex->last == NULL));
+    if(anIndex->top != NULL)
+    {
+      checkNode(anIndex->top);
+      checkNode(anIndex->last);
+      assert(anIndex->last->next == NULL);
+      assert(anIndex->top->objReferenceID <= anIndex->last->objReferenceID);
+    }
+  }
+  else if(fullWalk && anIndex->top != NULL)
   {
     //checking each individual node in the linked list is also valid
     Node* curr = anIndex->top;
-    while(curr != NULL)
+    while(curr->next != NULL)
     {
       checkNode(curr);
+      // nodes are kept in the order their reference ids were handed out
+      assert(curr->objReferenceID < curr->next->objReferenceID);
       curr = curr->next;
     }
+    checkNode(curr);
+    assert(anIndex->last == curr);
+  }
+  else if(fullWalk)
+  {
+    assert(anIndex->last == NULL);
   }
 } // end of checkIndex()
\ No newline at end of file
@@ -23,10 +23,88 @@
 
 #define NULL_REF 0
 
+// collection modes (see setCollectionMode)
+#define COLLECT_REFERENCE_COUNTING 0
+#define COLLECT_TRACING 1
+
+// tracepoint events (see getTraceEvents)
+#define EVENT_GC_START 1
+#define EVENT_GC_END 2
+#define EVENT_BUFFER_SWAP 3
+#define EVENT_ALLOC_FAILURE 4
+#define EVENT_HEAP_GROWTH 5
+#define EVENT_LOW_MEMORY 6
+
+// times an insert calls the low memory callback before giving up
+#ifndef LOW_MEMORY_RETRIES
+#define LOW_MEMORY_RETRIES 3
+#endif
+
+// invariant checking levels (see setCheckLevel)
+#define CHECK_NONE 0
+#define CHECK_NODES 1
+#define CHECK_SAMPLED 2
+#define CHECK_FULL 3
+
+// heap dump formats (see dumpPoolTo)
+#define DUMP_FORMAT_BINARY 0
+#define DUMP_FORMAT_JSON 1
+#define DUMP_BINARY_MAGIC 0x504d55444d424f48UL
+
+// recorded operations (see startOperationTrace)
+#define TRACE_INSERT 1
+#define TRACE_ADD_REFERENCE 2
+#define TRACE_DROP_REFERENCE 3
+#define TRACE_RETRIEVE 4
+#define TRACE_SET_REF_FIELD 5
+#define TRACE_CLONE 6
+#define TRACE_RESIZE 7
+#define TRACE_MAGIC 0x3243415254424f48UL
+
+// sharded pools (see initShardedPool)
+#define MAX_SHARDS 64
+#define SHARD_SHIFT 48
+#define SHARD_OF(ref) ((int)((ref) >> SHARD_SHIFT))
+
+// pages backing the buffers (see setHugePages)
+#define HUGE_PAGES_NONE 0
+#define HUGE_PAGES_TRANSPARENT 1
+#define HUGE_PAGES_EXPLICIT 2
+
 typedef unsigned long Ref;
+typedef unsigned long WeakRef;
 typedef unsigned long ulong;
 typedef unsigned char uchar;
 
+// a live object, as reported by nextObject
+typedef struct OBJECT_INFO ObjectInfo;
+struct OBJECT_INFO
+{
+  Ref ref;
+  ulong offset; // where its contents start in the buffer
+  ulong size;
+  ulong referenceCount;
+};
+
+// an event from the tracepoint event log (see getTraceEvents)
+typedef struct TRACE_EVENT TraceEvent;
+struct TRACE_EVENT
+{
+  ulong timeNs; // CLOCK_MONOTONIC
+  int type; // EVENT_*
+  ulong first;
+  ulong second;
+};
+
+// position of a walk over the live objects (see beginObjects)
+typedef struct OBJECT_ITERATOR ObjectIterator;
+struct OBJECT_ITERATOR
+{
+  Ref lastRef; // last object reported
+  void* lastNode; // its index entry, while lastEpoch is current
+  ulong lastEpoch;
+};
+
 /*
  * Note that we provide our entire interface via this object module
  * and completely hide our index (see course notes). This allows us to
@@ -42,6 +120,262 @@ typedef unsigned char uchar;
  */
 Ref insertObject( ulong size );
 
+/*
+ * Same as insertObject, but the first refSlotCount words of the object
+ * (refSlotCount * sizeof(Ref) bytes) are ref fields that start out as
+ * NULL_REF. A ref field holds a reference of its own on the object it
+ * points at, and when the object is collected the garbage collector
+ * drops those references in the same pass, so a graph of objects only
+ * reachable from a garbage object is collected along with it.
+ * Ref fields should be set with setRefField, which keeps the counts right.
+ */
+Ref insertObjectWithRefs( ulong size, ulong refSlotCount );
+
+/*
+ * Changes the size of an object without changing its reference. The
+ * object grows in place when it is the last one in the buffer or the
+ * blocks after it are garbage, and is moved otherwise (firing the
+ * garbage collector if that's what it takes to make room), so pointers
+ * from retrieveObject should be fetched again afterwards. The contents
+ * are kept up to the smaller of the two sizes; new bytes aren't cleared.
+ * The ref fields must fit in the new size. Returns 1 on success and 0 on
+ * failure, in which case the object is left as it was.
+ */
+int resizeObject( Ref ref, ulong newSize );
+
+/*
+ * Copy-on-write clones. cloneObject returns a new reference (held by the
+ * caller) to an object with the same size, contents and ref fields as
+ * the given one, without copying anything: the two share the contents
+ * until one of them is written. Pointers from retrieveObject must only
+ * be read; retrieveObjectForWrite first gives the object contents of its
+ * own if it shares them, and returns NULL if there is no room for that.
+ * setRefField and resizeObject do the same by themselves. cloneObject
+ * returns NULL_REF on failure.
+ */
+Ref cloneObject( Ref ref );
+void *retrieveObjectForWrite( Ref ref );
+
+/*
+ * Stores value in ref field slot of the object (NULL_REF clears the
+ * field). Returns 1 on success and 0 if the object is garbage, has no
+ * such field, or is a clone there is no room to copy, in which case the
+ * field is left as it was.
+ */
+int setRefField( Ref ref, ulong slot, Ref value );
+
+// returns the value of ref field slot of the object, NULL_REF if empty
+Ref getRefField( Ref ref, ulong slot );
+
+/*
+ * Objects that only reference each other through ref fields in a cycle
+ * never reach a count of 0. When a garbage collection would free less
+ * than the given percentage of memory, the cycle collector also looks
+ * for objects that can't be reached from outside the pool and collects
+ * them. 0 turns the cycle collector off. (default 5)
+ */
+void setCycleCollectionThreshold( int percent );
+
+/*
+ * Tracing mode. Call setCollectionMode(COLLECT_TRACING) before initPool
+ * to stop keeping reference counts altogether: addReference and
+ * dropReference do nothing, and the garbage collector keeps exactly the
+ * objects reachable through ref fields from the registered roots. A root
+ * is either a reference (addRoot) or the address of a variable holding
+ * one (addRootSlot), in which case whatever the variable holds at
+ * collection time is the root. A newly inserted object is safe until the
+ * next garbage collection, so it should be made reachable before the
+ * next insertObject call.
+ */
+void setCollectionMode( int mode );
+void addRoot( Ref ref );
+void removeRoot( Ref ref );
+void addRootSlot( Ref* slot );
+void removeRootSlot( Ref* slot );
+
+/*
+ * Weak references. A WeakRef refers to an object without keeping it
+ * alive. resolveWeak returns a pointer to the object for as long as the
+ * garbage collector hasn't reclaimed it (even after its last reference
+ * was dropped), and NULL once it has. promoteWeak turns a WeakRef back
+ * into a counted reference, bringing the object back to life if it was
+ * garbage but not yet reclaimed; the caller must drop that reference as
+ * usual. makeWeakRef and promoteWeak return NULL_REF on failure.
+ */
+WeakRef makeWeakRef( Ref ref );
+void *resolveWeak( WeakRef weak );
+Ref promoteWeak( WeakRef weak );
+
+/*
+ * Collection triggering. By default garbage collection only fires when
+ * an insertObject call doesn't fit in the remaining memory.
+ * setGcTriggerPolicy lets insertObject collect as soon as garbage makes
+ * up deadPercent of the used memory (0 = never early), and sets when
+ * gcMaybeCollect, which is meant to be called when the caller has time
+ * to spare, collects: once garbage makes up idlePercent of the used
+ * memory (default 25), or if memory would run out within headroomMs
+ * milliseconds at the rate it has been allocated since the last
+ * collection (0 = ignore the rate, the default). In tracing mode,
+ * everything allocated since the last collection counts as garbage.
+ * gcMaybeCollect returns 1 if it collected and 0 otherwise.
+ */
+void setGcTriggerPolicy( int deadPercent, int idlePercent, ulong headroomMs );
+int gcMaybeCollect();
+
+/*
+ * Running low on memory. When garbage collection doesn't make room for an
+ * insert, the callback set with setLowMemoryCallback is called with the
+ * bytes asked for and the context it was set with, so the program can drop
+ * references it can do without (e.g. cached objects). If it returns
+ * nonzero, garbage is collected again and the insert retried, up to
+ * LOW_MEMORY_RETRIES times; 0 means it has nothing left to give. It is
+ * called with the pool unlocked, and isn't called again for inserts it
+ * makes itself. NULL removes it (the default).
+ * setEmergencyReserve keeps the last bytes of the pool back from inserts
+ * (0 = none, the default), until one would fail even after the callback.
+ * That insert is made from the reserve instead, so the program keeps
+ * running while it sheds load, and isLowOnMemory returns 1 for as long
+ * as the pool stays in the reserve. Collections that bring it back under
+ * the reserve make the reserve whole again; while it is in the reserve,
+ * inserts only collect garbage again once something has been let go of
+ * (a reference dropped, a scope closed or an object shrunk) since the
+ * last collection, except in tracing mode. Objects growing with
+ * resizeObject and clones getting contents of their own are held back
+ * the same way: they only go into the reserve if collecting garbage
+ * doesn't make room, and they don't call the callback. For a sharded pool
+ * this is per shard, and isLowOnMemory is about the calling thread's shard.
+ */
+typedef int (*LowMemoryCallback)( ulong size, void* context );
+void setLowMemoryCallback( LowMemoryCallback callback, void* context );
+void setEmergencyReserve( ulong bytes );
+int isLowOnMemory();
+
+/*
+ * Hot object reordering. When on, one in every samplePeriod retrieveObject
+ * calls is counted towards the object retrieved, and garbage collection
+ * lays objects out with the most used ones first, next to each other,
+ * instead of in allocation order. 0 turns it off (the default).
+ */
+void setHotObjectReordering( ulong samplePeriod );
+
+/*
+ * Looking up a reference first tries a small direct mapped cache of
+ * recent lookups (TRANSLATION_CACHE_SIZE entries, set at compile time)
+ * before walking the index. The cache is emptied by every garbage
+ * collection. This reports the lookups answered by the cache (hits) and
+ * those that had to walk the index (misses) since initPool.
+ */
+void getTranslationCacheStats( ulong* hits, ulong* misses );
+
+/*
+ * Invariant checking, in builds without NDEBUG. Nodes are checked as they
+ * are used at every level but CHECK_NONE. CHECK_NODES checks only the ends
+ * of the index whenever the whole index would otherwise be checked, which
+ * keeps every check O(1); CHECK_SAMPLED also walks the whole index once
+ * every CHECK_SAMPLE_PERIOD of those times; CHECK_FULL walks it every time,
+ * which makes most operations O(n). The level starts at CHECK_LEVEL, which
+ * defaults to CHECK_FULL and can be set at build time (e.g.
+ * -DCHECK_LEVEL=CHECK_SAMPLED), and setCheckLevel changes it at run time.
+ * NDEBUG builds check nothing whatever the level.
+ */
+void setCheckLevel( int level );
+int getCheckLevel();
+
+/*
+ * Garbage collection statistics. setGcLogging(0) stops each garbage
+ * collection from printing its statistics (they are printed by default).
+ * getGcStats reports how many garbage collections the pool in use has run
+ * and how long the last one took, in nanoseconds.
+ */
+void setGcLogging( int enabled );
+void getGcStats( ulong* collections, ulong* lastPauseNs );
+
+/*
+ * Operation traces. startOperationTrace records every insertObject,
+ * insertObjectWithRefs, addReference, dropReference, retrieveObject
+ * (including retrieveObjectForWrite), setRefField, cloneObject and
+ * resizeObject call made from then on to a file, so a workload can be
+ * captured and replayed later (see TraceReplay.c). Calls the object
+ * manager makes on the caller's behalf, e.g. the reference a ref field
+ * takes, aren't recorded. The file holds two words (TRACE_MAGIC and
+ * MEMORY_SIZE) followed by four words per call: the nanoseconds since
+ * recording started shifted left 8 bits with the TRACE_* operation in the
+ * low byte, the reference (the one handed out, for inserts and clones),
+ * and two arguments, 0 when not used: the size and ref slot count for
+ * inserts, the slot and the value stored for setRefField, the reference
+ * cloned for cloneObject and the new size for resizeObject. All words are
+ * unsigned longs in the machine's byte order. Recording is buffered;
+ * stopOperationTrace writes out the rest. startOperationTrace returns 1
+ * on success and 0 on failure; stopOperationTrace returns 0 if any call
+ * couldn't be written.
+ */
+int startOperationTrace( const char* path );
+int stopOperationTrace();
+
+/*
+ * Tracepoints. Built with -DENABLE_TRACEPOINTS, the object manager marks
+ * the start and end of each garbage collection, buffer swaps, inserts that
+ * fail for want of room, the heap growing onto pages that aren't in
+ * memory and inserts made from the emergency reserve, in a log of the
+ * latest TRACE_EVENT_LOG_SIZE events, and as USDT probes in the
+ * "objectmanager" provider (gc_start, gc_end, buffer_swap, alloc_failure,
+ * heap_growth, low_memory) for perf or bpftrace when sys/sdt.h is
+ * available. The event values (first, second) are:
+ *   EVENT_GC_START      collection number, bytes in use before
+ *   EVENT_GC_END        pause in nanoseconds, bytes in use after
+ *   EVENT_BUFFER_SWAP   bytes copied to the other buffer, 0
+ *   EVENT_ALLOC_FAILURE bytes asked for, bytes in use
+ *   EVENT_HEAP_GROWTH   end of the pages in memory before and after
+ *   EVENT_LOW_MEMORY    bytes asked for, bytes in use
+ * Without the flag they compile to nothing. getTraceEvents copies up to
+ * maxEvents of the latest events, oldest first, and returns how many.
+ */
+ulong getTraceEvents( TraceEvent* events, ulong maxEvents );
+
+/*
+ * Heap profiling. setHeapProfiling(samplePeriod) tags one in every
+ * samplePeriod allocations with the allocation site set by the latest
+ * setAllocationSite call (a name that must stay valid, such as a string
+ * literal) and the number of garbage collections run so far. 0 turns it
+ * off (the default). writeHeapProfile writes the live tagged objects'
+ * counts and bytes per site and per age (garbage collections survived,
+ * in power of 2 buckets) to the given file, or the standard output for
+ * NULL, scaled up by the sample period. Lines are sorted, so the profiles
+ * taken at two points can be compared with diff. Shared pools aren't
+ * profiled. writeHeapProfile returns 1 on success and 0 on failure.
+ */
+void setHeapProfiling( ulong samplePeriod );
+void setAllocationSite( const char* site );
+int writeHeapProfile( const char* path );
+
+/*
+ * Giving memory back. With setPageRelease(1, slackBytes), every garbage
+ * collection tells the system it can take back the pages of the idle
+ * buffer and those past the used part of the active buffer, so the
+ * memory the pool takes up follows the live objects instead of staying
+ * at the busiest it has ever been. slackBytes past the used part stay
+ * in memory for upcoming allocations, and the rest is only given back
+ * once it is at least slackBytes too, so a pool that only grows and
+ * shrinks a little isn't affected. Off by default. getCommittedBytes
+ * reports how much of the buffers has been written since it was last
+ * given back, i.e. may be taking up memory.
+ */
+void setPageRelease( int enabled, ulong slackBytes );
+ulong getCommittedBytes();
+
+/*
+ * Huge pages. Call setHugePages before initPool or loadPool to back the
+ * buffers with 2MB pages, which cuts TLB misses when compacting or
+ * reading objects all over a large pool. HUGE_PAGES_EXPLICIT uses pages
+ * reserved by the administrator (vm.nr_hugepages), HUGE_PAGES_TRANSPARENT
+ * asks the kernel to assemble them, HUGE_PAGES_NONE uses normal pages
+ * (the default). If the pages asked for aren't available the next best
+ * are used; getHugePages reports what the pool in use ended up with.
+ * Shared pools always use normal pages.
+ */
+void setHugePages( int mode );
+int getHugePages();
+
 // returns a pointer to the object being requested given by the reference id
 void *retrieveObject( Ref ref );
 
@@ -65,4 +399,141 @@ void destroyPool();
  */
 void dumpPool();
 
+/*
+ * Walking the live objects. beginObjects starts a walk, and each call to
+ * nextObject fills in the next live object, in reference order, and
+ * returns 1, or returns 0 once there are none left. Each step takes
+ * constant time unless a garbage collection ran since the last one. The
+ * walk can go on while objects are inserted and dropped; objects inserted
+ * during the walk are reported too, and those collected aren't.
+ */
+void beginObjects( ObjectIterator* iterator );
+int nextObject( ObjectIterator* iterator, ObjectInfo* info );
+
+/*
+ * dumpPoolTo streams the live objects to an open file descriptor, through
+ * a buffer, without the cost of dumpPool's text. DUMP_FORMAT_JSON writes
+ * one line per object, {"ref":1,"offset":0,"size":100,"count":1}.
+ * DUMP_FORMAT_BINARY writes two words (DUMP_BINARY_MAGIC and MEMORY_SIZE)
+ * followed by four words per object (ref, offset, size and reference
+ * count) and four words of 0 at the end, all unsigned longs in the
+ * machine's byte order. The whole pool, every shard of a sharded one, is
+ * held while it is written, so the dump is a consistent snapshot; a
+ * sharded pool mustn't be dumped while holding a shard with lockShardOf.
+ * The descriptor is left open. Returns 1 on success and 0 on failure.
+ */
+int dumpPoolTo( int fd, int format );
+
+/*
+ * Persisting the pool. savePool collects garbage and writes the pool
+ * to a file; loadPool initialises the object manager from such a file
+ * (instead of initPool), mapping the objects back into memory so they
+ * are only read from disk when used. References handed out before the
+ * pool was saved keep referring to the same objects once it is loaded.
+ * Scopes, roots and logged reference count changes are not saved.
+ * Both return 1 on success and 0 on failure.
+ */
+int savePool( const char* path );
+int loadPool( const char* path );
+
+/*
+ * Shared pools. initSharedPool initialises the object manager (instead
+ * of initPool) with a pool kept in the POSIX shared memory segment with
+ * the given name, e.g. "/myPool". The first process to call it creates
+ * the segment with room for maxObjects objects at a time; later callers
+ * attach to it and maxObjects is ignored. Every process sees the same
+ * objects under the same Refs, and reference counts are shared, so a
+ * reference taken in one process keeps the object alive for all of
+ * them. Each call is made under a process-shared lock, which is given
+ * back if its holder dies. A pointer from retrieveObject can be moved by
+ * a garbage collection in another process, so hold the pool with
+ * lockPool/unlockPool (these nest) for as long as the pointer is used.
+ * destroyPool detaches; the last process to detach removes the segment.
+ * Shared pools need reference counting: they can't be used in tracing
+ * mode, changes are never deferred and scopes can't be opened.
+ * initSharedPool returns 1 on success and 0 on failure. lockPool and
+ * unlockPool do nothing for a pool that isn't shared, unless it is thread
+ * safe.
+ */
+int initSharedPool( const char* name, ulong maxObjects );
+void lockPool();
+void unlockPool();
+
+/*
+ * Threads. Call setThreadSafe(1) before initPool or loadPool to let
+ * several threads of the process use the pool at once: every call that
+ * touches objects, roots, scopes or the reference log then holds a lock,
+ * which lockPool/unlockPool also take to keep a pointer from retrieveObject
+ * valid while it is used. Setting the pool up and tearing it down
+ * (initPool, loadPool, destroyPool) and the set* configuration calls
+ * aren't locked, so make those before other threads start using the pool
+ * or after they are done. Pools aren't thread safe by default, so single
+ * threaded programs don't pay for locking.
+ */
+void setThreadSafe( int enabled );
+
+/*
+ * Unlocked calls, for front ends that lock the pool themselves (see
+ * ObjectPool.h). insertObjectUnlocked and retrieveObjectUnlocked are
+ * insertObject and retrieveObject without taking the pool's lock, so the
+ * caller must hold it (lockPool) if the pool is shared or thread safe.
+ * They don't work on sharded pools, where they return NULL_REF and NULL.
+ */
+Ref insertObjectUnlocked( ulong size );
+void *retrieveObjectUnlocked( Ref ref );
+
+/*
+ * Sharded pools. initShardedPool initialises the object manager (instead
+ * of initPool) with numShards (1 to MAX_SHARDS) independent pools of
+ * MEMORY_SIZE bytes, each with buffers, an index and a lock of its own,
+ * for threads that would otherwise all wait on one lock. Objects are
+ * allocated from the calling thread's shard: the one for the core it is
+ * running on, unless setHomeShard picked one (-1 goes back to the core's).
+ * The shard is kept in the top bits of every Ref (SHARD_OF gives it), so
+ * every other call goes straight to the object's shard, from any thread.
+ * A shard only collects garbage when it runs out of room or
+ * gcMaybeCollect is called from one of its threads, and only threads
+ * using that shard wait for it. Ref fields can point into other shards;
+ * the references a garbage object held in other shards are dropped when
+ * those shards next collect, and cycles spanning shards are never
+ * collected. An insert fails when its own shard is full, even if others
+ * have room. Sharded pools need reference counting, changes aren't
+ * deferred, scopes can't be opened, operations aren't recorded or
+ * profiled and the pool can't be saved. dumpPool, nextObject and the
+ * statistics cover every shard. lockShardOf/unlockShardOf (these nest)
+ * hold the shard an object is in, to keep a pointer from retrieveObject
+ * valid; lockPool only holds the first shard. initShardedPool returns 1
+ * on success and 0 on failure.
+ */
+int initShardedPool( int numShards );
+void setHomeShard( int shard );
+void lockShardOf( Ref ref );
+void unlockShardOf( Ref ref );
+
+/*
+ * Scoped regions. Every object allocated between a call to beginScope()
+ * and the matching endScope() is released by endScope() in a single
+ * operation, no matter how many references are still held on it. If the
+ * scope's objects sit at the end of the buffer, their memory is handed
+ * back straight away by rewinding the next available index; otherwise it
+ * is reclaimed by the next garbage collection. Scopes nest, and endScope()
+ * always closes the innermost open scope.
+ * beginScope returns the depth of the newly opened scope, or 0 on failure.
+ */
+int beginScope();
+void endScope();
+
+/*
+ * Deferred reference counting. While enabled, addReference and
+ * dropReference only log the change, and the logged changes are applied
+ * in batches: when the log fills up, when the garbage collector runs,
+ * when flushReferenceLog() is called, and when deferred counting is
+ * turned off again. An object whose count drops to zero part way through
+ * a batch is only treated as garbage if it is still at zero once the
+ * whole batch has been applied. Until then retrieveObject keeps
+ * returning objects whose count is about to reach zero.
+ */
+void setDeferredReferenceCounting( int enabled );
+void flushReferenceLog();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,401 @@
+/*
+ * ObjectPool.h
+ *
+ * Pool<Config>, a C++ front end to the object manager configured by a
+ * struct whose values the compiler folds into the pool's fast paths:
+ *
+ *   struct MyConfig
+ *   {
+ *     static constexpr ulong heapSize = MEMORY_SIZE;
+ *     static constexpr ulong alignment = 16;
+ *     static constexpr ulong sizeClasses[] = { 32, 64, 256 };
+ *     typedef int RefCount;
+ *     static constexpr bool threadSafe = false;
+ *   };
+ *   Pool<MyConfig> pool;
+ *   Pool<MyConfig>::Handle<Point> point = pool.make<Point>();
+ *
+ * The buffers are sized when ObjectManager.c is built, so heapSize must
+ * match the MEMORY_SIZE it was built with (build it with -DMEMORY_SIZE
+ * for another size, as the benchmarks are). Every object is rounded up to
+ * a multiple of alignment (a power of 2), so objects stay aligned to it
+ * through garbage collection as long as they are all allocated through the
+ * pool. Sizes up to the largest size class are then rounded up to the
+ * smallest class they fit in, so objects come in a few sizes only;
+ * sizeClasses must go up and be multiples of alignment. An empty class is
+ * spelt { 0 }. make<T>() does all of this at compile time.
+ *
+ * Inserting and retrieving through the pool (make, insert, get and
+ * handles' get) are inline and call the object manager's unlocked entry
+ * points, with the locking picked by threadSafe: a thread safe pool holds
+ * the object manager's lock around each call (see setThreadSafe), while
+ * in a pool that isn't, no locking is compiled into them at all.
+ *
+ * Handles from make() are counted by the pool in a RefCount, which must be
+ * an integer type wide enough for the most handles an object has at once.
+ * Copying or dropping one of them only changes that count (atomically in a
+ * thread safe pool), without calling the object manager, which holds one
+ * reference on the object for all of them until the last is gone.
+ *
+ * Only one pool can exist at a time, since it initialises the object
+ * manager for as long as it exists. Handles must be gone before it is.
+ */
+
+#ifndef _OBJECT_POOL_H
+#define _OBJECT_POOL_H
+
+#include "ObjectManager.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <type_traits>
+
+// handle counts allocated at a time
+#ifndef POOL_ENTRIES_PER_BLOCK
+#define POOL_ENTRIES_PER_BLOCK 256
+#endif
+
+template<typename Config>
+class Pool
+{
+private:
+  struct Entry;
+
+public:
+  static constexpr ulong heapSize = Config::heapSize;
+  static constexpr ulong alignment = Config::alignment;
+  static constexpr bool threadSafe = Config::threadSafe;
+  typedef typename Config::RefCount RefCount;
+
+  // a counted handle on an object of the pool, like Handle<T> from
+  // ObjectHandle.h with the counting done by the pool
+  template<typename T>
+  class Handle
+  {
+  public:
+    // a handle to nothing
+    Handle() : pool(NULL), entry(NULL) {}
+
+    Handle(const Handle& other) : pool(other.pool), entry(other.entry)
+    {
+      if(entry != NULL)
+      {
+        countUp(entry);
+      }
+    }
+
+    Handle(Handle&& other) noexcept : pool(other.pool), entry(other.entry)
+    {
+      other.pool = NULL;
+      other.entry = NULL;
+    }
+
+    Handle& operator=(const Handle& other)
+    {
+      // count before dropping, so assigning a handle to itself is harmless
+      if(other.entry != NULL)
+      {
+        countUp(other.entry);
+      }
+      reset();
+      pool = other.pool;
+      entry = other.entry;
+      return *this;
+    }
+
+    Handle& operator=(Handle&& other) noexcept
+    {
+      if(this != &other)
+      {
+        reset();
+        pool = other.pool;
+        entry = other.entry;
+        other.pool = NULL;
+        other.entry = NULL;
+      }
+      return *this;
+    }
+
+    ~Handle()
+    {
+      reset();
+    }
+
+    // the object, NULL if the handle is empty
+    T* get() const
+    {
+      return (entry != NULL) ? pool->template get<T>(entry->ref) : NULL;
+    }
+
+    T* operator->() const
+    {
+      return get();
+    }
+
+    T& operator*() const
+    {
+      return *get();
+    }
+
+    explicit operator bool() const
+    {
+      return entry != NULL;
+    }
+
+    // the reference, which stays held by the pool
+    Ref getRef() const
+    {
+      return (entry != NULL) ? entry->ref : NULL_REF;
+    }
+
+    // gives a reference of its own to the caller, who must drop it,
+    // and leaves the handle empty
+    Ref release()
+    {
+      Ref held = getRef();
+      if(held != NULL_REF)
+      {
+        addReference(held);
+        reset();
+      }
+      return held;
+    }
+
+    // lets go of the object and leaves the handle empty
+    void reset()
+    {
+      if(entry != NULL)
+      {
+        if(countDown(entry))
+        {
+          pool->letGo(entry);
+        }
+        pool = NULL;
+        entry = NULL;
+      }
+    }
+
+  private:
+    friend class Pool;
+
+    // takes over a count the pool has made for it
+    Handle(Pool* owner, Entry* held) : pool((held != NULL) ? owner : NULL), entry(held) {}
+
+    Pool* pool;
+    Entry* entry;
+  };
+
+  Pool() : blocks(NULL), freeEntries(NULL)
+  {
+    // checked here, where the whole class is defined
+    static_assert(heapSize == MEMORY_SIZE, "heapSize must match the MEMORY_SIZE ObjectManager.c is built with");
+    static_assert(alignment > 0 && (alignment & (alignment - 1)) == 0, "alignment must be a power of 2");
+    static_assert(std::is_integral<RefCount>::value, "RefCount must be an integer type");
+    static_assert(classesValid(), "sizeClasses must go up and be multiples of alignment");
+    setThreadSafe(threadSafe);
+    initPool();
+  }
+
+  ~Pool()
+  {
+    destroyPool();
+    setThreadSafe(0);
+    while(blocks != NULL)
+    {
+      EntryBlock* block = blocks;
+      blocks = blocks->next;
+      free(block);
+    }
+  }
+
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
+  // bytes actually allocated for an object of the given size
+  static constexpr ulong sizeFor(ulong size)
+  {
+    return classFor(roundUp(size));
+  }
+
+  // inserts an object of a size known at compile time, an empty
+  // handle if it doesn't fit
+  template<typename T>
+  Handle<T> make()
+  {
+    static_assert(sizeFor(sizeof(T)) <= heapSize, "the object doesn't fit in the pool");
+    constexpr ulong size = sizeFor(sizeof(T));
+    Guard guard;
+    return Handle<T>(this, hold(insertObjectUnlocked(size)));
+  }
+
+  // inserts an object whose size is only known at run time; the
+  // caller holds the reference
+  Ref insert(ulong size)
+  {
+    Ref ref = NULL_REF;
+    if(size > 0 && size <= heapSize)
+    {
+      Guard guard;
+      ref = insertObjectUnlocked(sizeFor(size));
+    }
+    return ref;
+  }
+
+  // changes an object's size, keeping it aligned
+  int resize(Ref ref, ulong size)
+  {
+    return (size > 0 && size <= heapSize) ? resizeObject(ref, sizeFor(size)) : 0;
+  }
+
+  template<typename T>
+  T* get(Ref ref) const
+  {
+    Guard guard;
+    return (T*)retrieveObjectUnlocked(ref);
+  }
+
+private:
+  // one object's handles, counted for the reference the pool holds
+  struct Entry
+  {
+    Ref ref;
+    RefCount count;
+    Entry* nextFree;
+  };
+
+  // entries are never moved, so handles can point at them
+  struct EntryBlock
+  {
+    EntryBlock* next;
+    Entry entries[POOL_ENTRIES_PER_BLOCK];
+  };
+
+  // holds the object manager's lock for as long as it exists, in a
+  // thread safe pool only
+  struct Guard
+  {
+    Guard()
+    {
+      if constexpr(threadSafe)
+      {
+        lockPool();
+      }
+    }
+
+    ~Guard()
+    {
+      if constexpr(threadSafe)
+      {
+        unlockPool();
+      }
+    }
+  };
+
+  EntryBlock* blocks;
+  Entry* freeEntries;
+
+  static void countUp(Entry* entry)
+  {
+    if constexpr(threadSafe)
+    {
+      __atomic_add_fetch(&(entry->count), 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+      entry->count++;
+    }
+  }
+
+  // true once the last handle is gone
+  static bool countDown(Entry* entry)
+  {
+    if constexpr(threadSafe)
+    {
+      return __atomic_sub_fetch(&(entry->count), 1, __ATOMIC_ACQ_REL) == 0;
+    }
+    else
+    {
+      return --(entry->count) == 0;
+    }
+  }
+
+  // starts counting handles on a reference the caller holds, NULL if
+  // there is none (the reference is dropped if no entry can be had);
+  // the caller holds the guard
+  Entry* hold(Ref ref)
+  {
+    Entry* entry = NULL;
+    if(ref != NULL_REF && freeEntries == NULL)
+    {
+      EntryBlock* block = (EntryBlock*)malloc(sizeof(EntryBlock));
+      if(block != NULL)
+      {
+        block->next = blocks;
+        blocks = block;
+        for(int i = 0; i < POOL_ENTRIES_PER_BLOCK; i++)
+        {
+          block->entries[i].nextFree = freeEntries;
+          freeEntries = &(block->entries[i]);
+        }
+      }
+    }
+    if(ref != NULL_REF && freeEntries != NULL)
+    {
+      entry = freeEntries;
+      freeEntries = entry->nextFree;
+      entry->ref = ref;
+      entry->count = 1;
+    }
+    else if(ref != NULL_REF)
+    {
+      dropReference(ref);
+    }
+    return entry;
+  }
+
+  // drops the pool's reference once the last handle is gone
+  void letGo(Entry* entry)
+  {
+    Guard guard;
+    dropReference(entry->ref);
+    entry->nextFree = freeEntries;
+    freeEntries = entry;
+  }
+
+  static constexpr ulong roundUp(ulong size)
+  {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  static constexpr ulong numClasses()
+  {
+    return sizeof(Config::sizeClasses) / sizeof(Config::sizeClasses[0]);
+  }
+
+  // the smallest size class the size fits in, the size if none
+  static constexpr ulong classFor(ulong size)
+  {
+    for(ulong i = 0; i < numClasses(); i++)
+    {
+      if(Config::sizeClasses[i] >= size)
+      {
+        return Config::sizeClasses[i];
+      }
+    }
+    return size;
+  }
+
+  static constexpr bool classesValid()
+  {
+    for(ulong i = 0; i < numClasses(); i++)
+    {
+      ulong previous = (i > 0) ? Config::sizeClasses[i - 1] : 0;
+      if(Config::sizeClasses[i] % alignment != 0 || (Config::sizeClasses[i] != 0 && Config::sizeClasses[i] <= previous))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+#endif
@@ -7,8 +7,15 @@
 //-----------------------------------------
 
 #include "ObjectManager.h"
+#include "ObjectHandle.h"
+#include "ObjectPool.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 // to keep track of total tests
 int testsPassed = 0;
@@ -20,6 +27,37 @@ static void testInsertObject();
 static void testRetrieveObject();
 static void testAddReference();
 static void testDropReference();
+static void testScopes();
+static void testDeferredReferenceCounting();
+static void testRefFields();
+static void testCycleCollection();
+static void testTracingMode();
+static void testWeakReferences();
+static void testGcTriggering();
+static void testPartialCompaction();
+static void testHotObjectReordering();
+static void testTranslationCache();
+static void testSaveLoadPool();
+static void testSharedPool();
+static void testPageRelease();
+static void testHugePages();
+static void testResizeObject();
+static void testCloneObject();
+static void testHeapProfiling();
+static void testHeapDump();
+static void testOperationTrace();
+static void testCheckLevels();
+static void testHandles();
+static ulong referenceCountOf(Ref ref);
+static void testPoolTemplate();
+static void* churnObjects(void* pool);
+static void testTracepoints();
+static void testShardedPool();
+static void* churnShards(void* hub);
+static void testLowMemory();
+static int dropCached(ulong size, void* cache);
+static int insertInCallback(ulong size, void* calls);
+static int profileContains(const char* path, const char* line);
 
 /*
 This function tests the functions from Object Manager
@@ -531,6 +569,2941 @@ static void testDropReference()
   printf("\n----------------------------------------END OF TESTING dropReference FUNCTION---------------------------------------\n");
 }
 
+/*
+This function tests the functions from Object Manager
+interface that open and close scoped regions of objects.
+*/
+static void testScopes()
+{
+  printf("\nTESTING BEGIN SCOPE and END SCOPE FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  // General Case 1: every object allocated in a scope is released by endScope, even with extra references
+  Ref outsideRef = insertObject(100);
+  beginScope();
+  Ref scopedRef1 = insertObject(2000);
+  Ref scopedRef2 = insertObject(3000);
+  addReference(scopedRef2);
+  endScope();
+
+  if(retrieveObject(scopedRef1) == NULL && retrieveObject(scopedRef2) == NULL && retrieveObject(outsideRef) != NULL)
+  {
+    printf("1. SUCCESS: expected every object allocated in the scope to be released and the object outside to survive, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected every object allocated in the scope to be released and the object outside to survive. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: a scope at the end of the buffer gives its memory back straight away
+  beginScope();
+  Ref scopedRef3 = insertObject(5000);
+  void* scopedPtr = retrieveObject(scopedRef3);
+  endScope();
+  Ref afterRef = insertObject(5000);
+
+  if(afterRef != NULL_REF && retrieveObject(afterRef) == scopedPtr)
+  {
+    printf("2. SUCCESS: expected the next object to reuse the memory of the released scope without garbage collection, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the next object to reuse the memory of the released scope without garbage collection. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  // Edge Case 1: closing an inner scope leaves the objects of the outer scope alone
+  beginScope();
+  Ref outerRef = insertObject(400);
+  beginScope();
+  Ref innerRef = insertObject(400);
+  endScope();
+
+  if(retrieveObject(outerRef) != NULL && retrieveObject(innerRef) == NULL)
+  {
+    printf("1. SUCCESS: closing the inner scope only released the inner scope's objects. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: closing the inner scope only released the inner scope's objects. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  endScope();
+
+  // Edge Case 2: closing a scope when none is open has no effect
+  Ref keptRef = insertObject(400);
+  endScope();
+
+  if(retrieveObject(keptRef) != NULL)
+  {
+    printf("2. SUCCESS: closing a scope when none is open has no effect on existing objects. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: closing a scope when none is open has no effect on existing objects. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING beginScope and endScope FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that defer reference count changes and apply
+them in batches.
+*/
+static void testDeferredReferenceCounting()
+{
+  printf("\nTESTING DEFERRED REFERENCE COUNTING\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  setDeferredReferenceCounting(1);
+  // General Case 1: dropped references only take effect once the log is flushed
+  Ref testRef25 = insertObject(300);
+  addReference(testRef25);
+  dropReference(testRef25);
+  dropReference(testRef25);
+  void* beforeFlush = retrieveObject(testRef25);
+  flushReferenceLog();
+  void* afterFlush = retrieveObject(testRef25);
+
+  if(beforeFlush != NULL && afterFlush == NULL)
+  {
+    printf("1. SUCCESS: expected the object to stay available until the log was flushed and to be garbage afterwards, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the object to stay available until the log was flushed and to be garbage afterwards. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: an object whose count bounces through 0 within one batch is not freed
+  Ref testRef26 = insertObject(300);
+  dropReference(testRef26);
+  addReference(testRef26);
+  flushReferenceLog();
+
+  if(retrieveObject(testRef26) != NULL)
+  {
+    printf("2. SUCCESS: expected an object that was only at 0 part way through a batch to survive, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected an object that was only at 0 part way through a batch to survive. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: garbage collection applies the log before deciding what is garbage
+  Ref testRef27 = insertObject(500000);
+  dropReference(testRef27);
+  Ref testRef28 = insertObject(100000);
+
+  if(testRef28 != NULL_REF)
+  {
+    printf("3. SUCCESS: expected garbage collection to apply the logged drop and make room, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected garbage collection to apply the logged drop and make room. This did not happen.\n");
+    testsFailed++;
+  }
+  setDeferredReferenceCounting(0);
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  setDeferredReferenceCounting(1);
+  // Edge Case 1: adding a reference to an object that is already garbage does not bring it back
+  Ref testRef29 = insertObject(200);
+  dropReference(testRef29);
+  flushReferenceLog();
+  addReference(testRef29);
+  flushReferenceLog();
+
+  if(retrieveObject(testRef29) == NULL)
+  {
+    printf("1. SUCCESS: cannot add references to an object that was already garbage before the batch. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot add references to an object that was already garbage before the batch. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: more changes than the log holds are applied as the log fills up
+  Ref testRef30 = insertObject(200);
+  for(int i = 0; i < 10000; i++)
+  {
+    addReference(testRef30);
+  }
+  for(int i = 0; i < 10000; i++)
+  {
+    dropReference(testRef30);
+  }
+  // turning deferred counting off applies the rest of the log
+  setDeferredReferenceCounting(0);
+  dropReference(testRef30);
+
+  if(retrieveObject(testRef30) == NULL)
+  {
+    printf("2. SUCCESS: every logged change was applied exactly once across several batches. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: every logged change was applied exactly once across several batches. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING deferred reference counting---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that create objects with ref fields and
+maintain those fields.
+*/
+static void testRefFields()
+{
+  printf("\nTESTING INSERT OBJECT WITH REFS, SET REF FIELD and GET REF FIELD FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  // General Case 1: ref fields start empty and hold what is stored in them
+  Ref parentRef = insertObjectWithRefs(64, 2);
+  Ref childRef1 = insertObject(1000);
+  Ref childRef2 = insertObjectWithRefs(1000, 1);
+  Ref grandchildRef = insertObject(1000);
+  Ref emptyField = getRefField(parentRef, 1);
+  setRefField(parentRef, 0, childRef1);
+  setRefField(parentRef, 1, childRef2);
+  setRefField(childRef2, 0, grandchildRef);
+
+  if(emptyField == NULL_REF && getRefField(parentRef, 0) == childRef1 && getRefField(parentRef, 1) == childRef2)
+  {
+    printf("1. SUCCESS: expected ref fields to start empty and then hold the references stored in them, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected ref fields to start empty and then hold the references stored in them. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: once the parent is garbage, garbage collection frees everything only it was holding
+  dropReference(childRef1);
+  dropReference(childRef2);
+  dropReference(grandchildRef);
+  int childrenHeld = (retrieveObject(childRef1) != NULL && retrieveObject(grandchildRef) != NULL);
+  dropReference(parentRef);
+  // fire garbage collection
+  insertObject(MEMORY_SIZE);
+
+  if(childrenHeld && retrieveObject(childRef1) == NULL && retrieveObject(childRef2) == NULL && retrieveObject(grandchildRef) == NULL)
+  {
+    printf("2. SUCCESS: expected the children to stay alive while the parent held them and to be collected with the parent, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the children to stay alive while the parent held them and to be collected with the parent. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  // Edge Case 1: asking for more ref fields than fit in the object
+  Ref tooManyFields = insertObjectWithRefs(16, 3);
+
+  if(tooManyFields == NULL_REF)
+  {
+    printf("1. SUCCESS: cannot create an object with more ref fields than fit in it. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot create an object with more ref fields than fit in it. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: a child that is still referenced elsewhere survives its parent
+  Ref parentRef2 = insertObjectWithRefs(sizeof(Ref), 1);
+  Ref sharedChild = insertObject(500);
+  setRefField(parentRef2, 0, sharedChild);
+  setRefField(parentRef2, 5, sharedChild);
+  dropReference(parentRef2);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(sharedChild) != NULL && getRefField(parentRef2, 0) == NULL_REF)
+  {
+    printf("2. SUCCESS: a child still referenced elsewhere survived its parent, and storing in a field that doesn't exist had no effect. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: a child still referenced elsewhere survived its parent, and storing in a field that doesn't exist had no effect. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 3: a parent released by closing its scope lets go of children outside the scope
+  Ref outsideChild = insertObject(500);
+  beginScope();
+  Ref scopedParent = insertObjectWithRefs(sizeof(Ref), 1);
+  setRefField(scopedParent, 0, outsideChild);
+  endScope();
+  dropReference(outsideChild);
+
+  if(retrieveObject(outsideChild) == NULL)
+  {
+    printf("3. SUCCESS: closing the scope dropped the reference the scoped parent held. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: closing the scope dropped the reference the scoped parent held. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING ref field FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests that garbage collection reclaims
+cycles of objects referencing each other through their
+ref fields.
+*/
+static void testCycleCollection()
+{
+  printf("\nTESTING CYCLE COLLECTION\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  // keeps the pool from ever being empty, so inserting MEMORY_SIZE bytes only fires garbage collection
+  Ref ballastRef = insertObject(1);
+  // General Case 1: two objects pointing at each other are collected once nothing outside refers to them
+  Ref cycleRef1 = insertObjectWithRefs(100, 1);
+  Ref cycleRef2 = insertObjectWithRefs(100, 1);
+  setRefField(cycleRef1, 0, cycleRef2);
+  setRefField(cycleRef2, 0, cycleRef1);
+  dropReference(cycleRef1);
+  dropReference(cycleRef2);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(cycleRef1) == NULL && retrieveObject(cycleRef2) == NULL)
+  {
+    printf("1. SUCCESS: expected the unreachable cycle to be collected, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the unreachable cycle to be collected. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: a cycle still reachable from an object referenced outside the pool survives
+  Ref holderRef = insertObjectWithRefs(100, 1);
+  Ref cycleRef3 = insertObjectWithRefs(100, 2);
+  Ref cycleRef4 = insertObjectWithRefs(100, 1);
+  Ref leafRef = insertObject(100);
+  setRefField(holderRef, 0, cycleRef3);
+  setRefField(cycleRef3, 0, cycleRef4);
+  setRefField(cycleRef3, 1, leafRef);
+  setRefField(cycleRef4, 0, cycleRef3);
+  dropReference(cycleRef3);
+  dropReference(cycleRef4);
+  dropReference(leafRef);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(cycleRef3) != NULL && retrieveObject(cycleRef4) != NULL && retrieveObject(leafRef) != NULL)
+  {
+    printf("2. SUCCESS: expected the cycle reachable from a live object to survive garbage collection, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the cycle reachable from a live object to survive garbage collection. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: once the holder is gone the cycle and everything it held are collected
+  dropReference(holderRef);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(cycleRef3) == NULL && retrieveObject(cycleRef4) == NULL && retrieveObject(leafRef) == NULL && retrieveObject(ballastRef) != NULL)
+  {
+    printf("3. SUCCESS: expected the cycle and the object it held to be collected with their holder, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the cycle and the object it held to be collected with their holder. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  ballastRef = insertObject(1);
+  // Edge Case 1: with the cycle collector turned off an object referring to itself is never collected
+  setCycleCollectionThreshold(0);
+  Ref selfRef = insertObjectWithRefs(100, 1);
+  setRefField(selfRef, 0, selfRef);
+  dropReference(selfRef);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(selfRef) != NULL)
+  {
+    printf("1. SUCCESS: an object referring to itself is not collected with the cycle collector off. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: an object referring to itself is not collected with the cycle collector off. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: turning the cycle collector back on collects it
+  setCycleCollectionThreshold(5);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(selfRef) == NULL)
+  {
+    printf("2. SUCCESS: an object referring to itself is collected with the cycle collector on. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: an object referring to itself is collected with the cycle collector on. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING cycle collection---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface used by the tracing collection mode.
+*/
+static void testTracingMode()
+{
+  printf("\nTESTING TRACING MODE WITH ADD ROOT and ADD ROOT SLOT FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  setCollectionMode(COLLECT_TRACING);
+  initPool();
+  // General Case 1: objects reachable from a root survive, everything else is collected
+  Ref rootRef = insertObjectWithRefs(100, 1);
+  addRoot(rootRef);
+  Ref reachableRef = insertObject(100);
+  setRefField(rootRef, 0, reachableRef);
+  Ref unreachableRef = insertObject(100);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(rootRef) != NULL && retrieveObject(reachableRef) != NULL && retrieveObject(unreachableRef) == NULL)
+  {
+    printf("1. SUCCESS: expected only the root and what it points at to survive garbage collection, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected only the root and what it points at to survive garbage collection. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: reference counting calls have no effect
+  dropReference(rootRef);
+  dropReference(rootRef);
+
+  if(retrieveObject(rootRef) != NULL)
+  {
+    printf("2. SUCCESS: expected dropping references to have no effect in tracing mode, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected dropping references to have no effect in tracing mode. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: a root variable keeps whatever it holds alive at collection time
+  Ref rootVariable = insertObject(100);
+  addRootSlot(&rootVariable);
+  Ref firstHeld = rootVariable;
+  insertObject(MEMORY_SIZE);
+  int firstSurvived = (retrieveObject(firstHeld) != NULL);
+  rootVariable = NULL_REF;
+  removeRoot(rootRef);
+  insertObject(MEMORY_SIZE);
+
+  if(firstSurvived && retrieveObject(firstHeld) == NULL && retrieveObject(rootRef) == NULL && retrieveObject(reachableRef) == NULL)
+  {
+    printf("3. SUCCESS: expected objects to survive only while a root refers to them, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected objects to survive only while a root refers to them. This did not happen.\n");
+    testsFailed++;
+  }
+  removeRootSlot(&rootVariable);
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: the collection mode can't change while an object manager is initialised
+  initPool();
+  setCollectionMode(COLLECT_REFERENCE_COUNTING);
+  Ref keptRef = insertObject(100);
+  addRoot(keptRef);
+  dropReference(keptRef);
+
+  if(retrieveObject(keptRef) != NULL)
+  {
+    printf("1. SUCCESS: the collection mode stayed tracing while the object manager was initialised. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: the collection mode stayed tracing while the object manager was initialised. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: a cycle reachable from no root is collected
+  Ref cycleRef1 = insertObjectWithRefs(100, 1);
+  Ref cycleRef2 = insertObjectWithRefs(100, 1);
+  setRefField(cycleRef1, 0, cycleRef2);
+  setRefField(cycleRef2, 0, cycleRef1);
+  insertObject(MEMORY_SIZE);
+
+  if(retrieveObject(cycleRef1) == NULL && retrieveObject(cycleRef2) == NULL && retrieveObject(keptRef) != NULL)
+  {
+    printf("2. SUCCESS: a cycle not reachable from any root was collected. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: a cycle not reachable from any root was collected. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+  setCollectionMode(COLLECT_REFERENCE_COUNTING);
+
+  printf("\n----------------------------------------END OF TESTING tracing mode---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that create and use weak references.
+*/
+static void testWeakReferences()
+{
+  printf("\nTESTING MAKE WEAK REF, RESOLVE WEAK and PROMOTE WEAK FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  Ref ballastRef = insertObject(1);
+  // General Case 1: a weak reference doesn't keep its object alive
+  Ref cachedRef = insertObject(400);
+  WeakRef cachedWeak = makeWeakRef(cachedRef);
+  int resolvedWhileHeld = (resolveWeak(cachedWeak) == retrieveObject(cachedRef));
+  dropReference(cachedRef);
+  int resolvedBeforeGC = (resolveWeak(cachedWeak) != NULL);
+  insertObject(MEMORY_SIZE);
+
+  if(resolvedWhileHeld && resolvedBeforeGC && resolveWeak(cachedWeak) == NULL)
+  {
+    printf("1. SUCCESS: expected the weak reference to resolve until garbage collection reclaimed the object, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the weak reference to resolve until garbage collection reclaimed the object. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: promoting a weak reference to garbage that hasn't been reclaimed brings it back
+  Ref cachedRef2 = insertObject(400);
+  WeakRef cachedWeak2 = makeWeakRef(cachedRef2);
+  dropReference(cachedRef2);
+  Ref promotedRef = promoteWeak(cachedWeak2);
+  insertObject(MEMORY_SIZE);
+
+  if(promotedRef == cachedRef2 && retrieveObject(promotedRef) != NULL)
+  {
+    printf("2. SUCCESS: expected the promoted object to survive garbage collection, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the promoted object to survive garbage collection. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: no weak reference can be made to an object that is already garbage
+  dropReference(promotedRef);
+  WeakRef deadWeak = makeWeakRef(promotedRef);
+
+  if(deadWeak == NULL_REF)
+  {
+    printf("1. SUCCESS: cannot make a weak reference to garbage. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot make a weak reference to garbage. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: a reclaimed object can't be promoted
+  Ref reclaimedRef = promoteWeak(cachedWeak);
+
+  if(reclaimedRef == NULL_REF && retrieveObject(ballastRef) != NULL)
+  {
+    printf("2. SUCCESS: cannot promote a weak reference to an object that was reclaimed. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot promote a weak reference to an object that was reclaimed. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING weak references---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that fire garbage collection before memory
+runs out.
+*/
+static void testGcTriggering()
+{
+  printf("\nTESTING SET GC TRIGGER POLICY and GC MAYBE COLLECT FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  // General Case 1: insertObject collects early once enough of the used memory is garbage
+  setGcTriggerPolicy(50, 25, 0);
+  Ref garbageRef = insertObject(1000);
+  Ref liveRef = insertObject(1000);
+  void* ptrBefore = retrieveObject(liveRef);
+  dropReference(garbageRef);
+  insertObject(10);
+  void* ptrAfter = retrieveObject(liveRef);
+
+  if(ptrAfter != NULL && ptrAfter != ptrBefore)
+  {
+    printf("1. SUCCESS: expected garbage collection to fire and move the live object although memory was available, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected garbage collection to fire and move the live object although memory was available. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: gcMaybeCollect collects once garbage reaches the idle threshold
+  setGcTriggerPolicy(0, 10, 0);
+  Ref garbageRef2 = insertObject(500);
+  dropReference(garbageRef2);
+
+  if(gcMaybeCollect() == 1 && gcMaybeCollect() == 0)
+  {
+    printf("2. SUCCESS: expected gcMaybeCollect to collect the garbage once and then find nothing to do, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected gcMaybeCollect to collect the garbage once and then find nothing to do. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: gcMaybeCollect collects little garbage if memory would run out soon at the current rate
+  setGcTriggerPolicy(0, 100, 1000000);
+  Ref garbageRef3 = insertObject(10);
+  insertObject(5000);
+  dropReference(garbageRef3);
+
+  if(gcMaybeCollect() == 1)
+  {
+    printf("3. SUCCESS: expected gcMaybeCollect to collect because memory would run out within the headroom, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected gcMaybeCollect to collect because memory would run out within the headroom. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  // Edge Case 1: without garbage gcMaybeCollect never collects
+  setGcTriggerPolicy(0, 0, 1000000);
+  insertObject(5000);
+
+  if(gcMaybeCollect() == 0)
+  {
+    printf("1. SUCCESS: gcMaybeCollect did not collect with no garbage in the pool. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: gcMaybeCollect did not collect with no garbage in the pool. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: garbage below the idle threshold is left alone
+  setGcTriggerPolicy(0, 50, 0);
+  Ref smallGarbage = insertObject(100);
+  dropReference(smallGarbage);
+
+  if(gcMaybeCollect() == 0)
+  {
+    printf("2. SUCCESS: gcMaybeCollect left garbage below the threshold alone. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: gcMaybeCollect left garbage below the threshold alone. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+  setGcTriggerPolicy(0, 25, 0);
+
+  printf("\n----------------------------------------END OF TESTING gc triggering---------------------------------------\n");
+}
+
+/*
+This function tests that garbage collection leaves the
+objects before the first garbage object where they are
+and keeps the contents of the objects it moves.
+*/
+static void testPartialCompaction()
+{
+  printf("\nTESTING PARTIAL COMPACTION\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  Ref prefixRef = insertObject(1000);
+  Ref garbageRef = insertObject(1000);
+  Ref movedRef = insertObject(1000);
+  char* prefixPtr = (char*)retrieveObject(prefixRef);
+  char* movedPtr = (char*)retrieveObject(movedRef);
+  for(int i = 0; i < 1000; i++)
+  {
+    prefixPtr[i] = (char)i;
+    movedPtr[i] = (char)(i * 3);
+  }
+  dropReference(garbageRef);
+  insertObject(MEMORY_SIZE);
+
+  // General Case 1: objects before the first garbage object stay where they are
+  if(retrieveObject(prefixRef) == prefixPtr)
+  {
+    printf("1. SUCCESS: expected the object before the garbage to stay where it was, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the object before the garbage to stay where it was. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: objects after it move down into the freed space with their contents intact
+  char* newMovedPtr = (char*)retrieveObject(movedRef);
+  int intact = (newMovedPtr == prefixPtr + 1000);
+  for(int i = 0; i < 1000 && intact; i++)
+  {
+    intact = (newMovedPtr[i] == (char)(i * 3) && prefixPtr[i] == (char)i);
+  }
+
+  if(intact)
+  {
+    printf("2. SUCCESS: expected the object after the garbage to move down with its contents intact, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the object after the garbage to move down with its contents intact. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  // Edge Case 1: when everything is garbage the whole buffer becomes available again
+  Ref onlyRef = insertObject(MEMORY_SIZE / 2);
+  dropReference(onlyRef);
+  Ref fullRef = insertObject(MEMORY_SIZE);
+
+  if(fullRef != NULL_REF)
+  {
+    printf("1. SUCCESS: the whole buffer was available again once everything was garbage. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: the whole buffer was available again once everything was garbage. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING partial compaction---------------------------------------\n");
+}
+
+/*
+This function tests the function from Object Manager
+interface that lays the most used objects out together
+during garbage collection.
+*/
+static void testHotObjectReordering()
+{
+  printf("\nTESTING SET HOT OBJECT REORDERING FUNCTION\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  setHotObjectReordering(1);
+  initPool();
+  // General Case 1: the objects retrieved the most are moved in front of the others
+  Ref coldRef = insertObject(100);
+  Ref warmRef = insertObject(100);
+  Ref hotRef = insertObject(100);
+  char* hotPtr = (char*)retrieveObject(hotRef);
+  hotPtr[0] = 'h';
+  for(int i = 0; i < 10; i++)
+  {
+    retrieveObject(hotRef);
+  }
+  retrieveObject(warmRef);
+  insertObject(MEMORY_SIZE);
+  char* newHotPtr = (char*)retrieveObject(hotRef);
+  char* newWarmPtr = (char*)retrieveObject(warmRef);
+  char* newColdPtr = (char*)retrieveObject(coldRef);
+
+  if(newHotPtr + 100 == newWarmPtr && newWarmPtr + 100 == newColdPtr && newHotPtr[0] == 'h')
+  {
+    printf("1. SUCCESS: expected the objects to be laid out from most to least used with their contents intact, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the objects to be laid out from most to least used with their contents intact. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: with reordering off objects stay in allocation order
+  setHotObjectReordering(0);
+  initPool();
+  coldRef = insertObject(100);
+  hotRef = insertObject(100);
+  for(int i = 0; i < 10; i++)
+  {
+    retrieveObject(hotRef);
+  }
+  insertObject(MEMORY_SIZE);
+
+  if((char*)retrieveObject(coldRef) + 100 == (char*)retrieveObject(hotRef))
+  {
+    printf("1. SUCCESS: objects stayed in allocation order with reordering off. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: objects stayed in allocation order with reordering off. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING hot object reordering---------------------------------------\n");
+}
+
+/*
+This function tests the lookup cache in front of the
+index through the function from Object Manager interface
+that reports its hits and misses.
+*/
+static void testTranslationCache()
+{
+  printf("\nTESTING GET TRANSLATION CACHE STATS FUNCTION\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  initPool();
+  ulong hits = 0;
+  ulong misses = 0;
+  // General Case 1: looking the same reference up again is answered by the cache
+  Ref garbageRef = insertObject(100);
+  Ref testRef = insertObject(100);
+  retrieveObject(testRef);
+  retrieveObject(testRef);
+  retrieveObject(testRef);
+  getTranslationCacheStats(&hits, &misses);
+
+  if(hits == 2 && misses == 1)
+  {
+    printf("1. SUCCESS: expected the first lookup to miss and the next two to hit the cache, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the first lookup to miss and the next two to hit the cache. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: after garbage collection moves the object the lookup finds its new location
+  dropReference(garbageRef);
+  void* oldPtr = retrieveObject(testRef);
+  insertObject(MEMORY_SIZE);
+  void* newPtr = retrieveObject(testRef);
+  ulong missesBefore = misses;
+  getTranslationCacheStats(&hits, &misses);
+
+  if(newPtr != NULL && newPtr != oldPtr && misses > missesBefore)
+  {
+    printf("2. SUCCESS: expected garbage collection to empty the cache so the moved object was looked up again, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected garbage collection to empty the cache so the moved object was looked up again. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  initPool();
+  // Edge Case 1: a reference that doesn't exist is never cached
+  retrieveObject(50);
+  retrieveObject(50);
+  getTranslationCacheStats(&hits, &misses);
+
+  if(hits == 0 && misses == 2)
+  {
+    printf("1. SUCCESS: lookups of a reference that doesn't exist always missed. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: lookups of a reference that doesn't exist always missed. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: objects released by closing a scope can't be found through the cache
+  beginScope();
+  Ref scopedRef = insertObject(100);
+  retrieveObject(scopedRef);
+  endScope();
+
+  if(retrieveObject(scopedRef) == NULL)
+  {
+    printf("2. SUCCESS: an object released by closing its scope could not be found through the cache. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: an object released by closing its scope could not be found through the cache. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING translation cache---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that save the memory pool to a file and load
+it back.
+*/
+static void testSaveLoadPool()
+{
+  printf("\nTESTING SAVE POOL and LOAD POOL FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  const char* imagePath = "/tmp/ObjectManagerTestSuite.pool";
+  initPool();
+  Ref garbageRef = insertObject(700);
+  Ref textRef = insertObject(32);
+  Ref parentRef = insertObjectWithRefs(64, 1);
+  setRefField(parentRef, 0, textRef);
+  snprintf((char*)retrieveObject(textRef), 32, "kept across a restart");
+  dropReference(garbageRef);
+  int saved = savePool(imagePath);
+  destroyPool();
+
+  // General Case 1: references from before the pool was saved refer to the same objects after loading it
+  int loaded = loadPool(imagePath);
+  char* text = (char*)retrieveObject(textRef);
+
+  if(saved && loaded && text != NULL && strcmp(text, "kept across a restart") == 0 && getRefField(parentRef, 0) == textRef && retrieveObject(garbageRef) == NULL)
+  {
+    printf("1. SUCCESS: expected the objects and their references to be the same after loading the pool, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the objects and their references to be the same after loading the pool. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: the loaded pool carries on as usual, handing out new references and counting references
+  Ref newRef = insertObject(100);
+  dropReference(textRef);
+  dropReference(parentRef);
+  insertObject(MEMORY_SIZE);
+
+  if(newRef > parentRef && retrieveObject(newRef) != NULL && retrieveObject(textRef) == NULL)
+  {
+    printf("2. SUCCESS: expected the loaded pool to hand out new references and collect garbage as usual, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the loaded pool to hand out new references and collect garbage as usual. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+  remove(imagePath);
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: loading a file that doesn't exist fails and leaves no object manager initialised
+  int missingLoaded = loadPool("/tmp/ObjectManagerTestSuite.missing");
+
+  if(missingLoaded == 0 && insertObject(10) == NULL_REF)
+  {
+    printf("1. SUCCESS: loading a missing file failed and no object manager was initialised. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: loading a missing file failed and no object manager was initialised. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: loading a pool while an object manager is initialised fails
+  initPool();
+  savePool(imagePath);
+
+  if(loadPool(imagePath) == 0)
+  {
+    printf("2. SUCCESS: cannot load a pool while an object manager is initialised. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot load a pool while an object manager is initialised. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+  remove(imagePath);
+
+  printf("\n----------------------------------------END OF TESTING savePool and loadPool FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that share a memory pool between processes.
+A child process attaches to the pool the test creates
+and the two pass references to each other through pipes.
+*/
+static void testSharedPool()
+{
+  printf("\nTESTING SHARED POOL FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  const char* poolName = "/ObjectManagerTestSuite";
+  int toChild[2];
+  int toParent[2];
+  pipe(toChild);
+  pipe(toParent);
+  // nothing buffered may be printed twice
+  fflush(stdout);
+  pid_t child = fork();
+  if(child == 0)
+  {
+    // the child attaches, checks the parent's object, keeps it alive and adds one of its own
+    Ref parentRef = NULL_REF;
+    Ref childRef = NULL_REF;
+    int ok = (read(toChild[0], &parentRef, sizeof(Ref)) == sizeof(Ref)) && initSharedPool(poolName, 1);
+    if(ok)
+    {
+      lockPool();
+      char* text = (char*)retrieveObject(parentRef);
+      ok = (text != NULL && strcmp(text, "from the parent") == 0);
+      unlockPool();
+      addReference(parentRef);
+      childRef = insertObject(32);
+      lockPool();
+      snprintf((char*)retrieveObject(childRef), 32, "from the child");
+      unlockPool();
+      destroyPool();
+    }
+    write(toParent[1], &childRef, sizeof(Ref));
+    _exit(ok ? 0 : 1);
+  }
+
+  int created = initSharedPool(poolName, 16);
+  Ref sharedRef = insertObject(32);
+  snprintf((char*)retrieveObject(sharedRef), 32, "from the parent");
+  write(toChild[1], &sharedRef, sizeof(Ref));
+  Ref childRef = NULL_REF;
+  read(toParent[0], &childRef, sizeof(Ref));
+  int status = 1;
+  waitpid(child, &status, 0);
+
+  // General Case 1: another process sees the same object under the same reference
+  if(created && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+  {
+    printf("1. SUCCESS: expected the child process to find the object under the reference it was given, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the child process to find the object under the reference it was given. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: the child's reference keeps the object alive, and its object is here too
+  dropReference(sharedRef);
+  insertObject(MEMORY_SIZE);
+  char* childText = (childRef != NULL_REF) ? (char*)retrieveObject(childRef) : NULL;
+
+  if(retrieveObject(sharedRef) != NULL && childText != NULL && strcmp(childText, "from the child") == 0)
+  {
+    printf("2. SUCCESS: expected references and objects from the child process to be in the pool, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected references and objects from the child process to be in the pool. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: when the index is full, garbage collection makes room for more
+  for(int i = 0; i < 14; i++)
+  {
+    insertObject(10);
+  }
+  Ref overflowRef = insertObject(10);
+  dropReference(childRef);
+  Ref roomRef = insertObject(10);
+
+  if(overflowRef == NULL_REF && roomRef != NULL_REF)
+  {
+    printf("1. SUCCESS: nothing was allocated while the index was full, and collecting garbage made room. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: nothing was allocated while the index was full, and collecting garbage made room. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: scopes can't be opened in a shared pool
+  if(beginScope() == 0)
+  {
+    printf("2. SUCCESS: cannot open a scope in a shared pool. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot open a scope in a shared pool. Did not observe expected behavior!\n");
+    testsFailed++;
+    endScope();
+  }
+  destroyPool();
+
+  // Edge Case 3: shared pools can't be used in tracing mode
+  setCollectionMode(COLLECT_TRACING);
+  int tracingCreated = initSharedPool(poolName, 16);
+  if(tracingCreated)
+  {
+    destroyPool();
+  }
+  setCollectionMode(COLLECT_REFERENCE_COUNTING);
+
+  if(tracingCreated == 0)
+  {
+    printf("3. SUCCESS: cannot use a shared pool in tracing mode. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: cannot use a shared pool in tracing mode. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  close(toChild[0]);
+  close(toChild[1]);
+  close(toParent[0]);
+  close(toParent[1]);
+
+  printf("\n----------------------------------------END OF TESTING SHARED POOL FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that give unused memory back to the system.
+*/
+static void testPageRelease()
+{
+  printf("\nTESTING PAGE RELEASE FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: after a burst is collected, only the live objects take up memory
+  setPageRelease(1, 0);
+  initPool();
+  Ref keptRef = insertObject(100);
+  snprintf((char*)retrieveObject(keptRef), 100, "still here");
+  Ref burstRef = insertObject(MEMORY_SIZE / 2);
+  memset(retrieveObject(burstRef), 0xff, MEMORY_SIZE / 2);
+  ulong burstCommitted = getCommittedBytes();
+  dropReference(burstRef);
+  insertObject(MEMORY_SIZE);
+  ulong afterCommitted = getCommittedBytes();
+
+  if(burstCommitted >= MEMORY_SIZE / 2 && afterCommitted < MEMORY_SIZE / 8)
+  {
+    printf("1. SUCCESS: expected the memory of the burst to be given back, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the memory of the burst to be given back. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: live objects are untouched and the memory given back can be allocated again
+  Ref againRef = insertObject(MEMORY_SIZE / 2);
+  uchar* again = (uchar*)retrieveObject(againRef);
+
+  if(strcmp((char*)retrieveObject(keptRef), "still here") == 0 && again != NULL && again[MEMORY_SIZE / 4] == 0)
+  {
+    printf("2. SUCCESS: expected live objects to be kept and the memory to be usable again, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected live objects to be kept and the memory to be usable again. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: a tail smaller than the slack is kept
+  setPageRelease(1, MEMORY_SIZE / 2);
+  initPool();
+  insertObject(100);
+  burstRef = insertObject(MEMORY_SIZE / 2);
+  memset(retrieveObject(burstRef), 0xff, MEMORY_SIZE / 2);
+  dropReference(burstRef);
+  insertObject(MEMORY_SIZE);
+
+  if(getCommittedBytes() >= MEMORY_SIZE / 2)
+  {
+    printf("1. SUCCESS: memory within the slack was kept. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: memory within the slack was kept. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // Edge Case 2: nothing is given back while page release is off
+  setPageRelease(0, 0);
+  initPool();
+  insertObject(100);
+  burstRef = insertObject(MEMORY_SIZE / 2);
+  dropReference(burstRef);
+  insertObject(MEMORY_SIZE);
+
+  if(getCommittedBytes() >= MEMORY_SIZE / 2)
+  {
+    printf("2. SUCCESS: no memory was given back while page release was off. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: no memory was given back while page release was off. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING PAGE RELEASE FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that back the buffers with huge pages. Huge
+pages may not be available where the tests run, so the
+pool has to work with whatever it ended up with.
+*/
+static void testHugePages()
+{
+  printf("\nTESTING HUGE PAGE FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: a pool asking for transparent huge pages works as usual across a garbage collection
+  setHugePages(HUGE_PAGES_TRANSPARENT);
+  initPool();
+  int transparent = getHugePages();
+  Ref garbageRef = insertObject(1000);
+  Ref keptRef = insertObject(100);
+  snprintf((char*)retrieveObject(keptRef), 100, "on a huge page");
+  dropReference(garbageRef);
+  insertObject(MEMORY_SIZE);
+
+  if(transparent != HUGE_PAGES_EXPLICIT && strcmp((char*)retrieveObject(keptRef), "on a huge page") == 0 && retrieveObject(garbageRef) == NULL)
+  {
+    printf("1. SUCCESS: expected the pool to work as usual with transparent huge pages, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the pool to work as usual with transparent huge pages. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // General Case 2: asking for explicit huge pages falls back if none are reserved
+  setHugePages(HUGE_PAGES_EXPLICIT);
+  initPool();
+  Ref bigRef = insertObject(MEMORY_SIZE / 2);
+  memset(retrieveObject(bigRef), 1, MEMORY_SIZE / 2);
+
+  if(bigRef != NULL_REF && ((uchar*)retrieveObject(bigRef))[MEMORY_SIZE / 2 - 1] == 1)
+  {
+    printf("2. SUCCESS: expected the pool to work with explicit huge pages or whatever it fell back to, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the pool to work with explicit huge pages or whatever it fell back to. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: a pool image can be loaded into buffers backed by huge pages
+  const char* imagePath = "/tmp/ObjectManagerTestSuite.pool";
+  int saved = savePool(imagePath);
+  destroyPool();
+  int loaded = loadPool(imagePath);
+  uchar* big = (uchar*)retrieveObject(bigRef);
+
+  if(saved && loaded && big != NULL && big[0] == 1 && big[MEMORY_SIZE / 2 - 1] == 1)
+  {
+    printf("1. SUCCESS: a saved pool was loaded into buffers backed by huge pages. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: a saved pool was loaded into buffers backed by huge pages. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  if(loaded)
+  {
+    destroyPool();
+  }
+  remove(imagePath);
+  setHugePages(HUGE_PAGES_NONE);
+
+  printf("\n----------------------------------------END OF TESTING HUGE PAGE FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the function from Object Manager
+interface that resizes objects.
+*/
+static void testResizeObject()
+{
+  printf("\nTESTING RESIZE OBJECT FUNCTION\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: the last object in the buffer grows where it is
+  initPool();
+  Ref firstRef = insertObject(100);
+  Ref lastRef = insertObject(100);
+  snprintf((char*)retrieveObject(lastRef), 100, "grown at the end");
+  void* before = retrieveObject(lastRef);
+  int grown = resizeObject(lastRef, 200);
+
+  if(grown && retrieveObject(lastRef) == before && strcmp((char*)before, "grown at the end") == 0)
+  {
+    printf("1. SUCCESS: expected the last object to grow in place, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the last object to grow in place. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // General Case 2: an object grows into the garbage right after it
+  initPool();
+  firstRef = insertObject(100);
+  Ref garbageRef = insertObject(100);
+  lastRef = insertObject(100);
+  snprintf((char*)retrieveObject(firstRef), 100, "grown into garbage");
+  snprintf((char*)retrieveObject(lastRef), 100, "left alone");
+  before = retrieveObject(firstRef);
+  dropReference(garbageRef);
+  grown = resizeObject(firstRef, 180);
+
+  if(grown && retrieveObject(firstRef) == before && strcmp((char*)before, "grown into garbage") == 0
+     && resolveWeak(garbageRef) == NULL && strcmp((char*)retrieveObject(lastRef), "left alone") == 0)
+  {
+    printf("2. SUCCESS: expected the object to take over the garbage after it, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the object to take over the garbage after it. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: an object with live objects after it is moved, keeping its reference and contents
+  grown = resizeObject(firstRef, 400);
+  char* moved = (char*)retrieveObject(firstRef);
+
+  if(grown && moved != before && moved != NULL && strcmp(moved, "grown into garbage") == 0 && strcmp((char*)retrieveObject(lastRef), "left alone") == 0)
+  {
+    printf("3. SUCCESS: expected the object to be moved with the same reference and contents, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the object to be moved with the same reference and contents. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: growing collects garbage when there is no room otherwise
+  initPool();
+  firstRef = insertObject(100);
+  garbageRef = insertObject(MEMORY_SIZE / 2);
+  lastRef = insertObject(MEMORY_SIZE / 4);
+  snprintf((char*)retrieveObject(lastRef), 100, "moved after collecting");
+  dropReference(garbageRef);
+  grown = resizeObject(lastRef, MEMORY_SIZE / 2);
+
+  if(grown && strcmp((char*)retrieveObject(lastRef), "moved after collecting") == 0 && retrieveObject(firstRef) != NULL)
+  {
+    printf("1. SUCCESS: garbage was collected to make room for the bigger object. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: garbage was collected to make room for the bigger object. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: an object can shrink, but not below its ref fields or to nothing
+  Ref parentRef = insertObjectWithRefs(4 * sizeof(Ref), 4);
+  int shrunk = resizeObject(firstRef, 10);
+  int belowFields = resizeObject(parentRef, 2 * sizeof(Ref));
+  int toNothing = resizeObject(firstRef, 0);
+
+  if(shrunk && belowFields == 0 && toNothing == 0 && retrieveObject(firstRef) != NULL)
+  {
+    printf("2. SUCCESS: the object shrank, but not below its ref fields or to nothing. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: the object shrank, but not below its ref fields or to nothing. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 3: an object bigger than the memory can't be had
+  if(resizeObject(firstRef, MEMORY_SIZE + 1) == 0)
+  {
+    printf("3. SUCCESS: cannot grow an object past the size of the memory. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: cannot grow an object past the size of the memory. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING resizeObject FUNCTION---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that make copy-on-write clones.
+*/
+static void testCloneObject()
+{
+  printf("\nTESTING CLONE OBJECT and RETRIEVE OBJECT FOR WRITE FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: a clone shares the contents of the object it was cloned from
+  initPool();
+  Ref sourceRef = insertObject(64);
+  snprintf((char*)retrieveObject(sourceRef), 64, "original");
+  Ref cloneRef = cloneObject(sourceRef);
+
+  if(cloneRef != NULL_REF && cloneRef != sourceRef && retrieveObject(cloneRef) == retrieveObject(sourceRef))
+  {
+    printf("1. SUCCESS: expected the clone to share the contents of the object, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the clone to share the contents of the object. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: writing the clone gives it its own contents and leaves the object alone
+  char* writable = (char*)retrieveObjectForWrite(cloneRef);
+  if(writable != NULL)
+  {
+    snprintf(writable, 64, "changed");
+  }
+
+  if(writable != NULL && writable != retrieveObject(sourceRef) && strcmp((char*)retrieveObject(sourceRef), "original") == 0
+     && strcmp((char*)retrieveObject(cloneRef), "changed") == 0)
+  {
+    printf("2. SUCCESS: expected only the clone to change when written, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected only the clone to change when written. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // General Case 3: a clone keeps the contents alive after the object it was cloned from is collected
+  initPool();
+  sourceRef = insertObject(64);
+  snprintf((char*)retrieveObject(sourceRef), 64, "kept by the clone");
+  cloneRef = cloneObject(sourceRef);
+  dropReference(sourceRef);
+  insertObject(MEMORY_SIZE);
+  char* shared = (char*)retrieveObject(cloneRef);
+
+  if(retrieveObject(sourceRef) == NULL && shared != NULL && strcmp(shared, "kept by the clone") == 0)
+  {
+    printf("3. SUCCESS: expected the clone to keep the contents alive, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the clone to keep the contents alive. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 4: the last object using the contents takes them over when written, without copying
+  char* owned = (char*)retrieveObjectForWrite(cloneRef);
+
+  if(owned == shared && strcmp(owned, "kept by the clone") == 0)
+  {
+    printf("4. SUCCESS: expected the clone to take the contents over without copying, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("4. FAILED: expected the clone to take the contents over without copying. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // General Case 5: a clone shares the ref fields too, which keep their objects alive until all clones are gone
+  initPool();
+  Ref childRef = insertObject(32);
+  Ref parentRef = insertObjectWithRefs(64, 1);
+  setRefField(parentRef, 0, childRef);
+  dropReference(childRef);
+  cloneRef = cloneObject(parentRef);
+  dropReference(parentRef);
+  insertObject(MEMORY_SIZE);
+  int childKept = (getRefField(cloneRef, 0) == childRef && retrieveObject(childRef) != NULL);
+  dropReference(cloneRef);
+  insertObject(MEMORY_SIZE);
+
+  if(childKept && retrieveObject(childRef) == NULL)
+  {
+    printf("5. SUCCESS: expected the shared ref field to keep its object alive until the clone was gone, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("5. FAILED: expected the shared ref field to keep its object alive until the clone was gone. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: garbage can't be cloned
+  initPool();
+  Ref garbageRef = insertObject(64);
+  dropReference(garbageRef);
+
+  if(cloneObject(garbageRef) == NULL_REF)
+  {
+    printf("1. SUCCESS: cannot clone garbage. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot clone garbage. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: clones still share their contents after the pool is saved and loaded
+  const char* imagePath = "/tmp/ObjectManagerTestSuite.pool";
+  sourceRef = insertObject(64);
+  snprintf((char*)retrieveObject(sourceRef), 64, "saved once");
+  cloneRef = cloneObject(sourceRef);
+  int saved = savePool(imagePath);
+  destroyPool();
+  int loaded = loadPool(imagePath);
+  shared = loaded ? (char*)retrieveObject(cloneRef) : NULL;
+
+  if(saved && shared != NULL && shared == retrieveObject(sourceRef) && strcmp(shared, "saved once") == 0)
+  {
+    printf("2. SUCCESS: the clone still shared its contents after loading the pool. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: the clone still shared its contents after loading the pool. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  if(loaded)
+  {
+    destroyPool();
+  }
+  remove(imagePath);
+
+  // Edge Case 3: a pool can be destroyed while clones still share their storage
+  initPool();
+  sourceRef = insertObject(64);
+  cloneRef = cloneObject(sourceRef);
+  destroyPool();
+  initPool();
+  Ref afterRef = insertObject(64);
+  destroyPool();
+
+  if(cloneRef != NULL_REF && afterRef != NULL_REF)
+  {
+    printf("3. SUCCESS: the pool was destroyed with live clones in it. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: the pool was destroyed with live clones in it. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 4: setting a ref field of a clone fails when there is no room to copy the clone
+  initPool();
+  childRef = insertObject(32);
+  parentRef = insertObjectWithRefs(MEMORY_SIZE / 2, 1);
+  cloneRef = cloneObject(parentRef);
+  Ref fillerRef = insertObject(MEMORY_SIZE - (MEMORY_SIZE / 2) - 32);
+  int set = setRefField(cloneRef, 0, childRef);
+
+  if(fillerRef != NULL_REF && !set && getRefField(cloneRef, 0) == NULL_REF && retrieveObject(cloneRef) == retrieveObject(parentRef))
+  {
+    printf("4. SUCCESS: cannot set a ref field of a clone without room to copy it. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("4. FAILED: cannot set a ref field of a clone without room to copy it. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING cloneObject and retrieveObjectForWrite FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function returns 1 if the heap profile in the given
+file has the given line, and 0 otherwise.
+*/
+static int profileContains(const char* path, const char* line)
+{
+  int found = 0;
+  char buffer[256];
+  FILE* in = fopen(path, "r");
+
+  if(in != NULL)
+  {
+    while(!found && fgets(buffer, sizeof(buffer), in) != NULL)
+    {
+      buffer[strcspn(buffer, "\n")] = '\0';
+      found = (strcmp(buffer, line) == 0);
+    }
+    fclose(in);
+  }
+  return found;
+}
+
+/*
+This function tests the functions from Object Manager
+interface that profile the heap.
+*/
+static void testHeapProfiling()
+{
+  const char* profilePath = "/tmp/ObjectManagerTestSuite.profile";
+
+  printf("\nTESTING SET HEAP PROFILING, SET ALLOCATION SITE and WRITE HEAP PROFILE FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: live objects are counted by the site they were allocated at
+  setHeapProfiling(1);
+  initPool();
+  setAllocationSite("alpha");
+  insertObject(100);
+  Ref droppedRef = insertObject(100);
+  insertObject(100);
+  dropReference(droppedRef);
+  setAllocationSite("beta");
+  insertObject(50);
+  int written = writeHeapProfile(profilePath);
+
+  if(written && profileContains(profilePath, "site alpha objects 2 bytes 200") && profileContains(profilePath, "site beta objects 1 bytes 50")
+     && profileContains(profilePath, "age 0-0 objects 3 bytes 250"))
+  {
+    printf("1. SUCCESS: expected the live objects to be counted by site, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the live objects to be counted by site. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: objects that survived a garbage collection are a collection older
+  insertObject(MEMORY_SIZE);
+  written = writeHeapProfile(profilePath);
+
+  if(written && profileContains(profilePath, "age 1-1 objects 3 bytes 250") && !profileContains(profilePath, "age 0-0 objects 3 bytes 250"))
+  {
+    printf("2. SUCCESS: expected the objects to age by one collection, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the objects to age by one collection. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // General Case 3: sampling one in 4 allocations still estimates all of them
+  setHeapProfiling(4);
+  initPool();
+  setAllocationSite("gamma");
+  for(int i = 0; i < 100; i++)
+  {
+    insertObject(10);
+  }
+  written = writeHeapProfile(profilePath);
+
+  if(written && profileContains(profilePath, "site gamma objects 100 bytes 1000"))
+  {
+    printf("3. SUCCESS: expected the sampled objects to be scaled up to all of them, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the sampled objects to be scaled up to all of them. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: objects allocated while profiling is off aren't in the profile
+  setHeapProfiling(0);
+  initPool();
+  insertObject(100);
+  written = writeHeapProfile(profilePath);
+
+  if(written && !profileContains(profilePath, "site alpha objects 1 bytes 100") && !profileContains(profilePath, "site unknown objects 1 bytes 100"))
+  {
+    printf("1. SUCCESS: objects allocated while profiling was off were left out. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: objects allocated while profiling was off were left out. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: a profile can't be written to a directory that doesn't exist
+  if(writeHeapProfile("/nonexistent/ObjectManagerTestSuite.profile") == 0)
+  {
+    printf("2. SUCCESS: cannot write a profile where there is no such directory. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot write a profile where there is no such directory. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+  setAllocationSite(NULL);
+  remove(profilePath);
+
+  printf("\n----------------------------------------END OF TESTING heap profiling FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that walk the live objects and stream them to
+a file.
+*/
+static void testHeapDump()
+{
+  const char* dumpPath = "/tmp/ObjectManagerTestSuite.dump";
+
+  printf("\nTESTING BEGIN OBJECTS, NEXT OBJECT and DUMP POOL TO FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: the walk reports the live objects in reference order
+  initPool();
+  Ref firstRef = insertObject(100);
+  Ref garbageRef = insertObject(200);
+  Ref lastRef = insertObject(300);
+  addReference(lastRef);
+  dropReference(garbageRef);
+  ObjectIterator iterator;
+  ObjectInfo first;
+  ObjectInfo last;
+  ObjectInfo extra;
+  beginObjects(&iterator);
+  int numFound = nextObject(&iterator, &first);
+  numFound = numFound + nextObject(&iterator, &last);
+  numFound = numFound + nextObject(&iterator, &extra);
+
+  if(numFound == 2 && first.ref == firstRef && first.size == 100 && first.offset == 0 && first.referenceCount == 1
+     && last.ref == lastRef && last.size == 300 && last.offset == 300 && last.referenceCount == 2)
+  {
+    printf("1. SUCCESS: expected the walk to report only the live objects, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the walk to report only the live objects. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: a walk carries on after a garbage collection moved the objects
+  beginObjects(&iterator);
+  nextObject(&iterator, &first);
+  insertObject(MEMORY_SIZE);
+  numFound = nextObject(&iterator, &last);
+
+  if(numFound && last.ref == lastRef && last.offset == 100 && nextObject(&iterator, &extra) == 0)
+  {
+    printf("2. SUCCESS: expected the walk to carry on at the moved object, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the walk to carry on at the moved object. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: the JSON lines dump has a line per live object
+  int fd = open(dumpPath, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  int dumped = dumpPoolTo(fd, DUMP_FORMAT_JSON);
+  char expected[256];
+  char text[256] = { 0 };
+  snprintf(expected, sizeof(expected), "{\"ref\":%lu,\"offset\":0,\"size\":100,\"count\":1}\n{\"ref\":%lu,\"offset\":100,\"size\":300,\"count\":2}\n",
+           firstRef, lastRef);
+  pread(fd, text, sizeof(text) - 1, 0);
+
+  if(dumped && strcmp(text, expected) == 0)
+  {
+    printf("3. SUCCESS: expected a JSON line per live object, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected a JSON line per live object. This did not happen.\n");
+    testsFailed++;
+  }
+  close(fd);
+
+  // General Case 4: the binary dump has a header, a record per live object and an empty record
+  fd = open(dumpPath, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  dumped = dumpPoolTo(fd, DUMP_FORMAT_BINARY);
+  ulong words[14] = { 0 };
+  ssize_t numBytes = pread(fd, words, sizeof(words), 0);
+
+  if(dumped && numBytes == (ssize_t)sizeof(words) && words[0] == DUMP_BINARY_MAGIC && words[1] == MEMORY_SIZE
+     && words[2] == firstRef && words[3] == 0 && words[4] == 100 && words[5] == 1
+     && words[6] == lastRef && words[7] == 100 && words[8] == 300 && words[9] == 2
+     && words[10] == 0 && words[11] == 0 && words[12] == 0 && words[13] == 0)
+  {
+    printf("4. SUCCESS: expected a binary record per live object, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("4. FAILED: expected a binary record per live object. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: the file descriptor is still open after a dump
+  if(lseek(fd, 0, SEEK_END) == (off_t)sizeof(words) && write(fd, "x", 1) == 1)
+  {
+    printf("1. SUCCESS: the file descriptor was still open after the dump. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: the file descriptor was still open after the dump. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  close(fd);
+
+  // Edge Case 2: an empty pool has nothing to walk and can't be dumped to a closed descriptor
+  initPool();
+  beginObjects(&iterator);
+
+  if(nextObject(&iterator, &extra) == 0 && dumpPoolTo(fd, DUMP_FORMAT_JSON) == 0)
+  {
+    printf("2. SUCCESS: an empty pool had nothing to walk and a closed file couldn't be written. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: an empty pool had nothing to walk and a closed file couldn't be written. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  destroyPool();
+  remove(dumpPath);
+
+  printf("\n----------------------------------------END OF TESTING heap dump FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that record operation traces and report on
+garbage collections.
+*/
+static void testOperationTrace()
+{
+  const char* tracePath = "/tmp/ObjectManagerTestSuite.trace";
+
+  printf("\nTESTING START OPERATION TRACE, STOP OPERATION TRACE and GET GC STATS FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: the caller's calls are recorded in order, with what they were on
+  int started = startOperationTrace(tracePath);
+  initPool();
+  Ref childRef = insertObject(100);
+  Ref parentRef = insertObjectWithRefs(sizeof(Ref), 1);
+  addReference(childRef);
+  retrieveObject(childRef);
+  setRefField(parentRef, 0, childRef);
+  dropReference(childRef);
+  Ref cloneRef = cloneObject(parentRef);
+  resizeObject(childRef, 200);
+  int stopped = stopOperationTrace();
+  insertObject(100);
+  destroyPool();
+
+  ulong words[2 + 8 * 4 + 1] = { 0 };
+  FILE* trace = fopen(tracePath, "r");
+  size_t numWords = (trace != NULL) ? fread(words, sizeof(ulong), 2 + 8 * 4 + 1, trace) : 0;
+  if(trace != NULL)
+  {
+    fclose(trace);
+  }
+  ulong expectedOps[8] = { TRACE_INSERT, TRACE_INSERT, TRACE_ADD_REFERENCE, TRACE_RETRIEVE, TRACE_SET_REF_FIELD,
+                           TRACE_DROP_REFERENCE, TRACE_CLONE, TRACE_RESIZE };
+  Ref expectedRefs[8] = { childRef, parentRef, childRef, childRef, parentRef, childRef, cloneRef, childRef };
+  ulong expectedFirsts[8] = { 100, sizeof(Ref), 0, 0, 0, 0, parentRef, 200 };
+  ulong expectedSeconds[8] = { 0, 1, 0, 0, childRef, 0, 0, 0 };
+  int matched = (started && stopped && numWords == 2 + 8 * 4 && words[0] == TRACE_MAGIC && words[1] == MEMORY_SIZE);
+  for(int i = 0; matched && i < 8; i++)
+  {
+    ulong* record = &(words[2 + i * 4]);
+    matched = ((record[0] & 0xff) == expectedOps[i] && record[1] == expectedRefs[i] && record[2] == expectedFirsts[i]
+               && record[3] == expectedSeconds[i] && (i == 0 || (record[0] >> 8) >= (record[-4] >> 8)));
+  }
+
+  if(matched)
+  {
+    printf("1. SUCCESS: expected the calls to be recorded in order, and not those made by setRefField, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the calls to be recorded in order, and not those made by setRefField. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: garbage collections are counted and timed
+  setGcLogging(0);
+  initPool();
+  ulong collections = 1;
+  ulong pauseNs = 1;
+  getGcStats(&collections, &pauseNs);
+  int noneYet = (collections == 0 && pauseNs == 0);
+  dropReference(insertObject(100));
+  insertObject(MEMORY_SIZE);
+  insertObject(MEMORY_SIZE);
+  getGcStats(&collections, &pauseNs);
+
+  if(noneYet && collections == 2 && pauseNs > 0)
+  {
+    printf("2. SUCCESS: expected both garbage collections to be counted and timed, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected both garbage collections to be counted and timed. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+  setGcLogging(1);
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: a trace can't be recorded to a directory that doesn't exist
+  if(startOperationTrace("/nonexistent/ObjectManagerTestSuite.trace") == 0 && stopOperationTrace() == 1)
+  {
+    printf("1. SUCCESS: cannot record where there is no such directory. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot record where there is no such directory. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  remove(tracePath);
+
+  printf("\n----------------------------------------END OF TESTING operation trace FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function tests the functions from Object Manager
+interface that set how thoroughly invariants are checked.
+*/
+static void testCheckLevels()
+{
+  printf("\nTESTING SET CHECK LEVEL and GET CHECK LEVEL FUNCTIONS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: the pool works the same at every level
+  int initialLevel = getCheckLevel();
+  int levels[4] = { CHECK_NONE, CHECK_NODES, CHECK_SAMPLED, CHECK_FULL };
+  int worked = 1;
+  for(int i = 0; i < 4; i++)
+  {
+    setCheckLevel(levels[i]);
+    worked = worked && getCheckLevel() == levels[i];
+    initPool();
+    Ref keptRef = insertObject(100);
+    for(int j = 0; j < 2000; j++)
+    {
+      dropReference(insertObject(1000));
+    }
+    snprintf((char*)retrieveObject(keptRef), 100, "level %d", levels[i]);
+    char expected[16];
+    snprintf(expected, sizeof(expected), "level %d", levels[i]);
+    worked = worked && strcmp((char*)retrieveObject(keptRef), expected) == 0;
+    destroyPool();
+  }
+
+  if(worked)
+  {
+    printf("1. SUCCESS: expected the pool to work the same at every check level, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the pool to work the same at every check level. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: a level that doesn't exist is ignored
+  setCheckLevel(CHECK_NODES);
+  setCheckLevel(CHECK_FULL + 1);
+
+  if(getCheckLevel() == CHECK_NODES)
+  {
+    printf("1. SUCCESS: a check level that doesn't exist was ignored. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: a check level that doesn't exist was ignored. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  setCheckLevel(initialLevel);
+
+  printf("\n----------------------------------------END OF TESTING check level FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function returns the reference count of a live
+object, and 0 if it isn't live.
+*/
+static ulong referenceCountOf(Ref ref)
+{
+  ObjectIterator iterator;
+  ObjectInfo info;
+  ulong count = 0;
+
+  beginObjects(&iterator);
+  while(count == 0 && nextObject(&iterator, &info))
+  {
+    if(info.ref == ref)
+    {
+      count = info.referenceCount;
+    }
+  }
+  return count;
+}
+
+/*
+This function tests the C++ handle template from
+ObjectHandle.h.
+*/
+static void testHandles()
+{
+  printf("\nTESTING THE HANDLE TEMPLATE\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: copies add a reference and going out of scope drops it
+  initPool();
+  Handle<long> first = Handle<long>::insert();
+  *first = 42;
+  ulong whileCopied = 0;
+  {
+    Handle<long> copy = first;
+    whileCopied = referenceCountOf(first.getRef());
+  }
+
+  if(first && whileCopied == 2 && referenceCountOf(first.getRef()) == 1 && *first.get() == 42)
+  {
+    printf("1. SUCCESS: expected the copy to hold a reference until it went away, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the copy to hold a reference until it went away. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: moving hands the reference over without changing the count
+  Ref ref = first.getRef();
+  Handle<long> moved = static_cast<Handle<long>&&>(first);
+  Handle<long> assigned;
+  assigned = static_cast<Handle<long>&&>(moved);
+
+  if(!first && !moved && assigned.getRef() == ref && referenceCountOf(ref) == 1)
+  {
+    printf("2. SUCCESS: expected the reference to move without changing the count, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the reference to move without changing the count. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: resetting the last handle makes the object garbage
+  assigned.reset();
+
+  if(!assigned && referenceCountOf(ref) == 0)
+  {
+    printf("3. SUCCESS: expected the object to become garbage with its last handle gone, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the object to become garbage with its last handle gone. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: assigning a handle to itself keeps the reference
+  Handle<long> self = Handle<long>::insert();
+  Handle<long>& alias = self;
+  self = alias;
+
+  if(self && referenceCountOf(self.getRef()) == 1)
+  {
+    printf("1. SUCCESS: assigning a handle to itself kept its reference. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: assigning a handle to itself kept its reference. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: a released reference is the caller's, and an empty handle has no object
+  Ref released = self.release();
+  Handle<long> empty;
+
+  if(!self && referenceCountOf(released) == 1 && empty.get() == NULL)
+  {
+    printf("2. SUCCESS: the released reference stayed held and the empty handle had no object. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: the released reference stayed held and the empty handle had no object. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+  dropReference(released);
+  destroyPool();
+
+  printf("\n----------------------------------------END OF TESTING the handle template---------------------------------------\n");
+}
+
+// pool configurations for testPoolTemplate
+struct AlignedConfig
+{
+  static constexpr ulong heapSize = MEMORY_SIZE;
+  static constexpr ulong alignment = 16;
+  static constexpr ulong sizeClasses[] = { 32, 64, 256 };
+  typedef int RefCount;
+  static constexpr bool threadSafe = false;
+};
+
+struct ThreadSafeConfig
+{
+  static constexpr ulong heapSize = MEMORY_SIZE;
+  static constexpr ulong alignment = 8;
+  static constexpr ulong sizeClasses[] = { 0 };
+  typedef short RefCount;
+  static constexpr bool threadSafe = true;
+};
+
+/*
+This function inserts, copies and drops objects over and
+over through a thread safe pool, to be run from several
+threads at once. It returns 1 if every insert worked.
+*/
+static void* churnObjects(void* pool)
+{
+  Pool<ThreadSafeConfig>* threadPool = (Pool<ThreadSafeConfig>*)pool;
+  long worked = 1;
+  for(int i = 0; i < 2000; i++)
+  {
+    Handle<long> sized(threadPool->insert(24 + i % 100));
+    Pool<ThreadSafeConfig>::Handle<long> object = threadPool->make<long>();
+    Pool<ThreadSafeConfig>::Handle<long> copy = object;
+    worked = worked && sized && object && copy.getRef() == object.getRef() && copy.get() != NULL;
+  }
+  return (void*)worked;
+}
+
+/*
+This function tests the compile time configured pool
+template from ObjectPool.h.
+*/
+static void testPoolTemplate()
+{
+  printf("\nTESTING THE POOL TEMPLATE\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: sizes are rounded up to the alignment, then to the size classes, at compile time
+  static_assert(Pool<AlignedConfig>::sizeFor(40) == 64, "40 bytes go in the 64 byte class");
+  static_assert(Pool<AlignedConfig>::sizeFor(300) == 304, "300 bytes are past the classes");
+  int aligned = 1;
+  {
+    Pool<AlignedConfig> pool;
+    Pool<AlignedConfig>::Handle<char[40]> small = pool.make<char[40]>();
+    Ref garbageRef = pool.insert(3);
+    Ref largeRef = pool.insert(300);
+    dropReference(garbageRef);
+    insertObject(MEMORY_SIZE);
+
+    ObjectIterator iterator;
+    ObjectInfo info;
+    int numObjects = 0;
+    beginObjects(&iterator);
+    while(nextObject(&iterator, &info))
+    {
+      aligned = aligned && info.offset % 16 == 0;
+      numObjects++;
+    }
+    aligned = aligned && numObjects == 2 && pool.get<char>(largeRef) != NULL && small.get() != NULL;
+    dropReference(largeRef);
+  }
+
+  if(aligned)
+  {
+    printf("1. SUCCESS: expected the objects to stay aligned through garbage collection, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the objects to stay aligned through garbage collection. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: a thread safe pool can be used from several threads at once
+  int allWorked = 1;
+  ulong numLeft = 1;
+  {
+    Pool<ThreadSafeConfig> pool;
+    setGcLogging(0);
+    pthread_t threads[4];
+    for(int i = 0; i < 4; i++)
+    {
+      pthread_create(&threads[i], NULL, churnObjects, &pool);
+    }
+    for(int i = 0; i < 4; i++)
+    {
+      void* worked = NULL;
+      pthread_join(threads[i], &worked);
+      allWorked = allWorked && worked != NULL;
+    }
+    setGcLogging(1);
+
+    ObjectIterator iterator;
+    ObjectInfo info;
+    numLeft = 0;
+    beginObjects(&iterator);
+    while(nextObject(&iterator, &info))
+    {
+      numLeft++;
+    }
+  }
+
+  if(allWorked && numLeft == 0)
+  {
+    printf("2. SUCCESS: expected every thread's objects to be inserted and dropped, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected every thread's objects to be inserted and dropped. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: copies of a pool's handle are counted by the pool, which holds one reference until the last goes
+  ulong heldCount = 0;
+  int keptWhileHeld = 0;
+  int freedAfter = 0;
+  {
+    Pool<AlignedConfig> pool;
+    Pool<AlignedConfig>::Handle<long> first = pool.make<long>();
+    *first = 42;
+    {
+      Pool<AlignedConfig>::Handle<long> second = first;
+      Pool<AlignedConfig>::Handle<long> third;
+      third = second;
+      ObjectIterator iterator;
+      ObjectInfo info;
+      beginObjects(&iterator);
+      if(nextObject(&iterator, &info))
+      {
+        heldCount = info.referenceCount;
+      }
+    }
+    setGcLogging(0);
+    insertObject(MEMORY_SIZE);
+    keptWhileHeld = (*first == 42);
+    // once the last handle is gone, the whole heap can be had
+    first.reset();
+    Ref wholeRef = insertObject(MEMORY_SIZE);
+    setGcLogging(1);
+    freedAfter = (wholeRef != NULL_REF);
+    dropReference(wholeRef);
+  }
+
+  if(heldCount == 1 && keptWhileHeld && freedAfter)
+  {
+    printf("3. SUCCESS: expected the pool to hold one reference for every copy of a handle, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the pool to hold one reference for every copy of a handle. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: nothing, or more than the heap, can't be had
+  Ref nothingRef = NULL_REF;
+  Ref tooBigRef = NULL_REF;
+  {
+    Pool<AlignedConfig> pool;
+    nothingRef = pool.insert(0);
+    tooBigRef = pool.insert(MEMORY_SIZE + 1);
+  }
+
+  if(nothingRef == NULL_REF && tooBigRef == NULL_REF)
+  {
+    printf("1. SUCCESS: cannot insert nothing or more than the heap. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot insert nothing or more than the heap. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: the unlocked calls the pool uses refuse a sharded pool
+  initShardedPool(2);
+  Ref shardedRef = insertObject(16);
+  Ref unlockedRef = insertObjectUnlocked(16);
+  void* unlockedObject = retrieveObjectUnlocked(shardedRef);
+  dropReference(shardedRef);
+  destroyPool();
+
+  if(unlockedRef == NULL_REF && unlockedObject == NULL)
+  {
+    printf("2. SUCCESS: cannot insert or retrieve without locking in a sharded pool. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot insert or retrieve without locking in a sharded pool. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  printf("\n----------------------------------------END OF TESTING the pool template---------------------------------------\n");
+}
+
+/*
+This function tests the tracepoint event log. It only
+has events when built with -DENABLE_TRACEPOINTS.
+*/
+static void testTracepoints()
+{
+  printf("\nTESTING GET TRACE EVENTS FUNCTION\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: a collection that can't make room leaves its events in order
+  TraceEvent events[64];
+  initPool();
+  Ref keptRef = insertObject(MEMORY_SIZE / 2);
+  insertObject(MEMORY_SIZE);
+  ulong numEvents = getTraceEvents(events, 64);
+  int inOrder = 0;
+#ifdef ENABLE_TRACEPOINTS
+  int step = 0;
+  for(ulong i = 0; i < numEvents; i++)
+  {
+    if(step == 0 && events[i].type == EVENT_HEAP_GROWTH && events[i].second >= MEMORY_SIZE / 2)
+    {
+      step = 1;
+    }
+    else if(step == 1 && events[i].type == EVENT_GC_START && events[i].second == MEMORY_SIZE / 2)
+    {
+      step = 2;
+    }
+    else if(step == 2 && events[i].type == EVENT_GC_END)
+    {
+      step = 3;
+    }
+    else if(step == 3 && events[i].type == EVENT_ALLOC_FAILURE && events[i].first == MEMORY_SIZE)
+    {
+      step = 4;
+    }
+    inOrder = (step == 4);
+  }
+#else
+  // without tracepoints there is nothing to log
+  inOrder = (numEvents == 0);
+#endif
+
+  if(inOrder && retrieveObject(keptRef) != NULL)
+  {
+    printf("1. SUCCESS: expected the growth, collection and failure events in order, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the growth, collection and failure events in order. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: no more events are copied than there is room for
+  if(getTraceEvents(events, 1) <= 1 && getTraceEvents(events, 0) == 0 && getTraceEvents(NULL, 64) == 0)
+  {
+    printf("1. SUCCESS: no more events were copied than there was room for. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: no more events were copied than there was room for. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  printf("\n----------------------------------------END OF TESTING tracepoint FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This function inserts objects from the shard of whatever
+core the thread runs on, points them at the hub object and
+drops them, over and over, to be run from several threads
+at once. It returns 1 if every insert worked.
+*/
+static void* churnShards(void* hub)
+{
+  long worked = 1;
+  for(int i = 0; i < 20000; i++)
+  {
+    Ref ref = insertObjectWithRefs(32, 1);
+    setRefField(ref, 0, *(Ref*)hub);
+    worked = worked && ref != NULL_REF && getRefField(ref, 0) == *(Ref*)hub;
+    dropReference(ref);
+  }
+  return (void*)worked;
+}
+
+/*
+This function tests the functions from Object Manager
+interface for sharded pools.
+*/
+static void testShardedPool()
+{
+  printf("\nTESTING SHARDED POOLS\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+  setGcLogging(0);
+
+  // General Case 1: every object is allocated from the home shard, which its ref names
+  int initialised = initShardedPool(4);
+  int inHomeShard = initialised;
+  for(int shard = 0; shard < 4; shard++)
+  {
+    setHomeShard(shard);
+    Ref ref = insertObject(64);
+    inHomeShard = inHomeShard && SHARD_OF(ref) == shard && retrieveObject(ref) != NULL;
+    dropReference(ref);
+  }
+
+  if(inHomeShard)
+  {
+    printf("1. SUCCESS: expected each object to come from its home shard, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected each object to come from its home shard. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 2: a ref field in one shard keeps an object in another alive until both have collected
+  setHomeShard(0);
+  Ref parentRef = insertObjectWithRefs(64, 1);
+  setHomeShard(1);
+  Ref childRef = insertObject(64);
+  WeakRef childWeak = makeWeakRef(childRef);
+  setRefField(parentRef, 0, childRef);
+  dropReference(childRef);
+  dropReference(parentRef);
+  // there isn't room for these, so shard 0 and then shard 1 collect
+  setHomeShard(0);
+  insertObject(MEMORY_SIZE);
+  int keptAlive = (resolveWeak(childWeak) != NULL);
+  setHomeShard(1);
+  insertObject(MEMORY_SIZE);
+
+  if(keptAlive && resolveWeak(childWeak) == NULL)
+  {
+    printf("2. SUCCESS: expected the other shard's object to be kept until its shard collected, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the other shard's object to be kept until its shard collected. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: a shard collecting leaves the objects of the others where they are
+  setHomeShard(2);
+  Ref garbageRef = insertObject(1000);
+  Ref keptRef = insertObject(64);
+  dropReference(garbageRef);
+  void* before = retrieveObject(keptRef);
+  ulong collectionsBefore = 0;
+  ulong collectionsAfter = 0;
+  getGcStats(&collectionsBefore, NULL);
+  setHomeShard(3);
+  insertObject(MEMORY_SIZE);
+  getGcStats(&collectionsAfter, NULL);
+
+  if(collectionsAfter == collectionsBefore + 1 && retrieveObject(keptRef) == before && before != NULL)
+  {
+    printf("3. SUCCESS: expected a collection in one shard not to move another's objects, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected a collection in one shard not to move another's objects. This did not happen.\n");
+    testsFailed++;
+  }
+  dropReference(keptRef);
+  destroyPool();
+
+  // General Case 4: threads on different shards share an object through ref fields
+  initShardedPool(4);
+  setHomeShard(0);
+  Ref hubRef = insertObject(64);
+  setHomeShard(-1);
+  pthread_t threads[4];
+  for(int i = 0; i < 4; i++)
+  {
+    pthread_create(&threads[i], NULL, churnShards, &hubRef);
+  }
+  int allWorked = 1;
+  for(int i = 0; i < 4; i++)
+  {
+    void* worked = NULL;
+    pthread_join(threads[i], &worked);
+    allWorked = allWorked && worked != NULL;
+  }
+  // the hub's shard collects last, once every drop has been sent to it
+  for(int shard = 3; shard >= 0; shard--)
+  {
+    setHomeShard(shard);
+    insertObject(MEMORY_SIZE);
+  }
+  setHomeShard(-1);
+
+  if(allWorked && referenceCountOf(hubRef) == 1)
+  {
+    printf("4. SUCCESS: expected every thread's references to the shared object to be let go of, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("4. FAILED: expected every thread's references to the shared object to be let go of. This did not happen.\n");
+    testsFailed++;
+  }
+  dropReference(hubRef);
+  destroyPool();
+  setGcLogging(1);
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: too few or too many shards, or a second object manager
+  int noShards = initShardedPool(0);
+  int tooMany = initShardedPool(MAX_SHARDS + 1);
+  initPool();
+  int second = initShardedPool(2);
+  destroyPool();
+
+  if(!noShards && !tooMany && !second)
+  {
+    printf("1. SUCCESS: cannot initialise a sharded pool with no or too many shards, or twice. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: cannot initialise a sharded pool with no or too many shards, or twice. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: sharded pools can't be saved or have scopes
+  initShardedPool(2);
+  int saved = savePool("/tmp/sharded.pool");
+  int depth = beginScope();
+  destroyPool();
+
+  if(!saved && depth == 0)
+  {
+    printf("2. SUCCESS: cannot save a sharded pool or open a scope in it. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot save a sharded pool or open a scope in it. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  printf("\n----------------------------------------END OF TESTING sharded pool FUNCTIONS---------------------------------------\n");
+}
+
+/*
+This low memory callback drops the cached object it is
+given, if it is still holding it.
+*/
+static int dropCached(ulong size, void* cache)
+{
+  Ref* cached = (Ref*)cache;
+  int released = (*cached != NULL_REF);
+  if(released)
+  {
+    dropReference(*cached);
+    *cached = NULL_REF;
+  }
+  return released;
+}
+
+/*
+This low memory callback counts its calls and tries an
+insert of its own, which mustn't call it again.
+*/
+static int insertInCallback(ulong size, void* calls)
+{
+  (*(int*)calls)++;
+  insertObject(size);
+  return 1;
+}
+
+/*
+This function tests the functions from Object Manager
+interface for running low on memory.
+*/
+static void testLowMemory()
+{
+  printf("\nTESTING LOW MEMORY CALLBACK AND EMERGENCY RESERVE\n\n");
+  printf("---------------------------------------------Testing General Cases----------------------------------------------\n");
+
+  // General Case 1: the callback drops a cached object so the insert fits after all
+  initPool();
+  Ref cachedRef = insertObject(MEMORY_SIZE / 2);
+  setLowMemoryCallback(dropCached, &cachedRef);
+  Ref bigRef = insertObject(MEMORY_SIZE / 2 + 1);
+  setLowMemoryCallback(NULL, NULL);
+
+  if(bigRef != NULL_REF && cachedRef == NULL_REF && retrieveObject(bigRef) != NULL)
+  {
+    printf("1. SUCCESS: expected the callback to make room for the insert, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: expected the callback to make room for the insert. This did not happen.\n");
+    testsFailed++;
+  }
+  destroyPool();
+
+  // General Case 2: the reserve is only used once nothing else fits, until it is given back
+  setEmergencyReserve(MEMORY_SIZE / 4);
+  initPool();
+  Ref firstRef = insertObject(MEMORY_SIZE / 2);
+  Ref secondRef = insertObject(MEMORY_SIZE / 4);
+  int lowBefore = isLowOnMemory();
+  ulong collectionsBefore = 0;
+  ulong collectionsAfter = 0;
+  getGcStats(&collectionsBefore, NULL);
+  Ref reserveRef = insertObject(MEMORY_SIZE / 8);
+  getGcStats(&collectionsAfter, NULL);
+  int lowDuring = isLowOnMemory();
+  dropReference(firstRef);
+  dropReference(reserveRef);
+  insertObject(MEMORY_SIZE);
+  int lowAfter = isLowOnMemory();
+  destroyPool();
+  setEmergencyReserve(0);
+
+  if(secondRef != NULL_REF && reserveRef != NULL_REF && collectionsAfter == collectionsBefore + 1 && !lowBefore && lowDuring && !lowAfter)
+  {
+    printf("2. SUCCESS: expected the reserve to be used as a last resort and given back, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: expected the reserve to be used as a last resort and given back. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 3: an object that grows collects garbage rather than move into the reserve
+  setEmergencyReserve(MEMORY_SIZE / 4);
+  initPool();
+  Ref growingRef = insertObject(MEMORY_SIZE / 4);
+  Ref keptRef = insertObject(MEMORY_SIZE / 8);
+  dropReference(insertObject(MEMORY_SIZE / 4));
+  getGcStats(&collectionsBefore, NULL);
+  int grown = resizeObject(growingRef, 3 * (MEMORY_SIZE / 8));
+  getGcStats(&collectionsAfter, NULL);
+  int lowGrown = isLowOnMemory();
+  destroyPool();
+
+  if(keptRef != NULL_REF && grown && collectionsAfter == collectionsBefore + 1 && !lowGrown)
+  {
+    printf("3. SUCCESS: expected the object to grow outside the reserve after collecting, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: expected the object to grow outside the reserve after collecting. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 4: a clone's own copy collects garbage rather than go into the reserve
+  initPool();
+  Ref sourceRef = insertObject(MEMORY_SIZE / 4);
+  Ref cloneRef = cloneObject(sourceRef);
+  dropReference(insertObject(MEMORY_SIZE / 4));
+  keptRef = insertObject(MEMORY_SIZE / 8);
+  getGcStats(&collectionsBefore, NULL);
+  void* copy = retrieveObjectForWrite(cloneRef);
+  getGcStats(&collectionsAfter, NULL);
+  int lowCopied = isLowOnMemory();
+  destroyPool();
+  setEmergencyReserve(0);
+
+  if(keptRef != NULL_REF && copy != NULL && collectionsAfter == collectionsBefore + 1 && !lowCopied)
+  {
+    printf("4. SUCCESS: expected the clone to be copied outside the reserve after collecting, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("4. FAILED: expected the clone to be copied outside the reserve after collecting. This did not happen.\n");
+    testsFailed++;
+  }
+
+  // General Case 5: in the reserve, garbage is only collected again once something is let go of
+  setEmergencyReserve(MEMORY_SIZE / 4);
+  initPool();
+  insertObject(MEMORY_SIZE / 2);
+  insertObject(MEMORY_SIZE / 4);
+  ulong collectionsFirst = 0;
+  ulong collectionsSecond = 0;
+  ulong collectionsThird = 0;
+  getGcStats(&collectionsBefore, NULL);
+  Ref firstReserveRef = insertObject(MEMORY_SIZE / 16);
+  getGcStats(&collectionsFirst, NULL);
+  Ref secondReserveRef = insertObject(MEMORY_SIZE / 16);
+  getGcStats(&collectionsSecond, NULL);
+  dropReference(firstReserveRef);
+  Ref thirdReserveRef = insertObject(MEMORY_SIZE / 16);
+  getGcStats(&collectionsThird, NULL);
+  destroyPool();
+  setEmergencyReserve(0);
+
+  if(firstReserveRef != NULL_REF && secondReserveRef != NULL_REF && thirdReserveRef != NULL_REF
+     && collectionsFirst == collectionsBefore + 1 && collectionsSecond == collectionsFirst && collectionsThird == collectionsSecond + 1)
+  {
+    printf("5. SUCCESS: expected a collection only when something had been let go of, which is what happened.\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("5. FAILED: expected a collection only when something had been let go of. This did not happen.\n");
+    testsFailed++;
+  }
+
+  printf("\n-----------------------------------------------Testing Edge Cases-----------------------------------------------\n");
+
+  // Edge Case 1: inserts the callback makes itself don't call it again
+  int calls = 0;
+  initPool();
+  insertObject(MEMORY_SIZE);
+  setLowMemoryCallback(insertInCallback, &calls);
+  Ref failedRef = insertObject(1);
+  setLowMemoryCallback(NULL, NULL);
+  destroyPool();
+
+  if(failedRef == NULL_REF && calls == LOW_MEMORY_RETRIES)
+  {
+    printf("1. SUCCESS: the callback was retried a few times and never called from itself. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("1. FAILED: the callback was retried a few times and never called from itself. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 2: a callback with nothing to give leaves the insert failed
+  Ref noneRef = NULL_REF;
+  initPool();
+  insertObject(MEMORY_SIZE);
+  setLowMemoryCallback(dropCached, &noneRef);
+  Ref stillFailedRef = insertObject(1);
+  setLowMemoryCallback(NULL, NULL);
+  destroyPool();
+
+  if(stillFailedRef == NULL_REF)
+  {
+    printf("2. SUCCESS: cannot insert when the callback has nothing to give. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("2. FAILED: cannot insert when the callback has nothing to give. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  // Edge Case 3: an object only grows into the reserve when nothing can be collected
+  setEmergencyReserve(MEMORY_SIZE / 4);
+  initPool();
+  growingRef = insertObject(MEMORY_SIZE / 8);
+  keptRef = insertObject(5 * (MEMORY_SIZE / 8));
+  grown = resizeObject(growingRef, MEMORY_SIZE / 4);
+  lowGrown = isLowOnMemory();
+  destroyPool();
+  setEmergencyReserve(0);
+
+  if(keptRef != NULL_REF && grown && lowGrown)
+  {
+    printf("3. SUCCESS: the object grew into the reserve as a last resort. Observed expected behavior!\n");
+    testsPassed++;
+  }
+  else
+  {
+    printf("3. FAILED: the object grew into the reserve as a last resort. Did not observe expected behavior!\n");
+    testsFailed++;
+  }
+
+  printf("\n----------------------------------------END OF TESTING low memory FUNCTIONS---------------------------------------\n");
+}
+
 int main()
 {
   //calling all test functions
@@ -539,6 +3512,31 @@ int main()
   testRetrieveObject();
   testAddReference();
   testDropReference();
+  testScopes();
+  testDeferredReferenceCounting();
+  testRefFields();
+  testCycleCollection();
+  testTracingMode();
+  testWeakReferences();
+  testGcTriggering();
+  testPartialCompaction();
+  testHotObjectReordering();
+  testTranslationCache();
+  testSaveLoadPool();
+  testSharedPool();
+  testPageRelease();
+  testHugePages();
+  testResizeObject();
+  testCloneObject();
+  testHeapProfiling();
+  testHeapDump();
+  testOperationTrace();
+  testCheckLevels();
+  testHandles();
+  testPoolTemplate();
+  testTracepoints();
+  testShardedPool();
+  testLowMemory();
 
   //final Summary
   printf("\n---------------------------------------------FINAL TESTING SUMMARY----------------------------------------------\n");
@@ -548,4 +3546,4 @@ int main()
 
   printf("\nEND OF PROGRAM\n");
   return 0;
-}
\ No newline at end of file
+}
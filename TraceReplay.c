@@ -0,0 +1,245 @@
+//-----------------------------------------
+//
+// REMARKS: Replays an operation trace recorded with
+//          startOperationTrace against the object
+//          manager, as fast as it can, and reports the
+//          throughput, the garbage collections and how
+//          long they paused for. Build with "make replay"
+//          and run "./replay trace-file".
+//-----------------------------------------
+
+#include "ObjectManager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// operations read from the trace at a time
+#define REPLAY_CHUNK 4096
+
+//function prototypes
+static double elapsedNs(struct timespec* start, struct timespec* end);
+static int comparePauses(const void* a, const void* b);
+static ulong percentile(ulong* pauses, ulong numPauses, int percent);
+static int replayTrace(FILE* trace);
+
+/*
+This function returns the nanoseconds between two
+readings of the monotonic clock.
+*/
+static double elapsedNs(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/*
+This function orders pauses from shortest to longest
+for qsort.
+*/
+static int comparePauses(const void* a, const void* b)
+{
+  ulong first = *(const ulong*)a;
+  ulong second = *(const ulong*)b;
+  return (first > second) - (first < second);
+}
+
+/*
+This function returns the pause that the given percent
+of the sorted pauses are no longer than.
+*/
+static ulong percentile(ulong* pauses, ulong numPauses, int percent)
+{
+  ulong index = (numPauses * percent + 99) / 100;
+  return pauses[(index > 0) ? index - 1 : 0];
+}
+
+/*
+This function replays the operations in a trace on a new
+pool and prints what it found. References in the trace
+are mapped to the ones the replay hands out, and calls on
+objects whose insert failed are skipped. It returns 1 if
+the whole trace was replayed and 0 otherwise.
+*/
+static int replayTrace(FILE* trace)
+{
+  ulong header[2];
+  if(fread(header, sizeof(header), 1, trace) != 1 || header[0] != TRACE_MAGIC)
+  {
+    printf("Not an operation trace.\n");
+    return 0;
+  }
+  if(header[1] != MEMORY_SIZE)
+  {
+    printf("The trace was recorded with a %lu byte pool, replaying it with %lu bytes.\n", header[1], (ulong)MEMORY_SIZE);
+  }
+
+  ulong (*records)[4] = (ulong(*)[4])malloc(sizeof(ulong) * 4 * REPLAY_CHUNK);
+  ulong mapCapacity = 1024;
+  Ref* refMap = (Ref*)calloc(mapCapacity, sizeof(Ref)); // traced ref to replayed ref
+  ulong pausesCapacity = 1024;
+  ulong* pauses = (ulong*)malloc(sizeof(ulong) * pausesCapacity);
+  ulong numPauses = 0;
+  ulong numOps[TRACE_RESIZE + 1] = { 0 };
+  ulong numSkipped = 0;
+  ulong numFailedInserts = 0;
+  ulong recordedNs = 0;
+  ulong collections = 0;
+  ulong lastCollections = 0;
+  ulong pauseNs = 0;
+  int ok = 1;
+
+  setGcLogging(0);
+  initPool();
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  size_t numRecords = fread(records, sizeof(ulong) * 4, REPLAY_CHUNK, trace);
+  while(ok && numRecords > 0)
+  {
+    for(size_t i = 0; ok && i < numRecords; i++)
+    {
+      ulong op = records[i][0] & 0xff;
+      Ref tracedRef = records[i][1];
+      recordedNs = records[i][0] >> 8;
+      Ref ref = (tracedRef < mapCapacity) ? refMap[tracedRef] : NULL_REF;
+      // the object cloned, or the value a ref field was set to
+      Ref tracedArg = (op == TRACE_CLONE) ? records[i][2] : records[i][3];
+      Ref arg = (tracedArg < mapCapacity) ? refMap[tracedArg] : NULL_REF;
+
+      if(op == TRACE_INSERT || op == TRACE_CLONE)
+      {
+        if(op == TRACE_INSERT)
+        {
+          ref = insertObjectWithRefs(records[i][2], records[i][3]);
+          if(ref == NULL_REF)
+          {
+            numFailedInserts++;
+          }
+        }
+        else if(arg != NULL_REF)
+        {
+          ref = cloneObject(arg);
+        }
+        else
+        {
+          ref = NULL_REF;
+          numSkipped++;
+        }
+        if(tracedRef != NULL_REF)
+        {
+          while(tracedRef >= mapCapacity)
+          {
+            refMap = (Ref*)realloc(refMap, sizeof(Ref) * mapCapacity * 2);
+            memset(&(refMap[mapCapacity]), 0, sizeof(Ref) * mapCapacity);
+            mapCapacity = mapCapacity * 2;
+          }
+          refMap[tracedRef] = ref;
+        }
+      }
+      else if(op > TRACE_RESIZE)
+      {
+        printf("Unknown operation %lu in the trace.\n", op);
+        ok = 0;
+      }
+      else if(ref == NULL_REF || (op == TRACE_SET_REF_FIELD && arg == NULL_REF && tracedArg != NULL_REF))
+      {
+        numSkipped++;
+      }
+      else if(op == TRACE_SET_REF_FIELD)
+      {
+        setRefField(ref, records[i][2], arg);
+      }
+      else if(op == TRACE_RESIZE)
+      {
+        resizeObject(ref, records[i][2]);
+      }
+      else if(op == TRACE_ADD_REFERENCE)
+      {
+        addReference(ref);
+      }
+      else if(op == TRACE_DROP_REFERENCE)
+      {
+        dropReference(ref);
+      }
+      else
+      {
+        volatile uchar* object = (volatile uchar*)retrieveObject(ref);
+        if(object != NULL)
+        {
+          (void)object[0];
+        }
+      }
+      if(op <= TRACE_RESIZE)
+      {
+        numOps[op]++;
+      }
+
+      getGcStats(&collections, &pauseNs);
+      if(collections != lastCollections)
+      {
+        if(numPauses == pausesCapacity)
+        {
+          pausesCapacity = pausesCapacity * 2;
+          pauses = (ulong*)realloc(pauses, sizeof(ulong) * pausesCapacity);
+        }
+        pauses[numPauses] = pauseNs;
+        numPauses++;
+        lastCollections = collections;
+      }
+    }
+    numRecords = fread(records, sizeof(ulong) * 4, REPLAY_CHUNK, trace);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  destroyPool();
+
+  ulong totalOps = 0;
+  for(ulong op = TRACE_INSERT; op <= TRACE_RESIZE; op++)
+  {
+    totalOps = totalOps + numOps[op];
+  }
+  double replayNs = elapsedNs(&start, &end);
+  printf("\nOperations: %lu (insert %lu, addReference %lu, dropReference %lu, retrieve %lu, setRefField %lu, clone %lu, resize %lu)\n",
+         totalOps, numOps[TRACE_INSERT], numOps[TRACE_ADD_REFERENCE], numOps[TRACE_DROP_REFERENCE], numOps[TRACE_RETRIEVE],
+         numOps[TRACE_SET_REF_FIELD], numOps[TRACE_CLONE], numOps[TRACE_RESIZE]);
+  printf("Failed inserts: %lu   Skipped calls on failed inserts: %lu\n", numFailedInserts, numSkipped);
+  printf("Recorded over: %.3f ms   Replayed in: %.3f ms\n", recordedNs / 1e6, replayNs / 1e6);
+  printf("Throughput: %.0f operations per second\n", (replayNs > 0) ? totalOps / (replayNs / 1e9) : 0.0);
+  printf("Garbage collections: %lu\n", numPauses);
+  if(numPauses > 0)
+  {
+    ulong totalPauseNs = 0;
+    for(ulong i = 0; i < numPauses; i++)
+    {
+      totalPauseNs = totalPauseNs + pauses[i];
+    }
+    qsort(pauses, numPauses, sizeof(ulong), comparePauses);
+    printf("Pause (us): min %.1f   p50 %.1f   p90 %.1f   p99 %.1f   max %.1f   total %.1f\n",
+           pauses[0] / 1e3, percentile(pauses, numPauses, 50) / 1e3, percentile(pauses, numPauses, 90) / 1e3,
+           percentile(pauses, numPauses, 99) / 1e3, pauses[numPauses - 1] / 1e3, totalPauseNs / 1e3);
+  }
+
+  free(pauses);
+  free(refMap);
+  free(records);
+  return ok;
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc != 2)
+  {
+    printf("Usage: %s trace-file\n", argv[0]);
+    return 1;
+  }
+
+  FILE* trace = fopen(argv[1], "r");
+  if(trace == NULL)
+  {
+    printf("Unable to open %s\n", argv[1]);
+    return 1;
+  }
+  int ok = replayTrace(trace);
+  fclose(trace);
+  return ok ? 0 : 1;
+}